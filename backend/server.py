@@ -1,84 +1,133 @@
 """
 Streamlined FastAPI FPS App
-- POST /ingest: store numeric FPS values
-- Keeps last 500 rows + global min + global max
+- POST /ingest: store one numeric FPS value
+- POST /ingest/batch: frame-time samples from TelemetryClient (src/telemetry.cpp),
+  summarised per batch into a window with percentiles
+- Keeps the last 500 FPS points + global min + global max, and the last
+  2000 windows, in memory; a write is an append to a ring
 - GET /chart-data: return series + stats
+- GET /windows: recent windows, optionally for one source
 - POST /clear: delete all data
 - / : modern minimal UI (Tailwind + Chart.js) with clear button
 """
 
+import math
+from collections import deque
+from datetime import datetime
+from threading import Lock
+from typing import Dict, List, Optional
+
 from fastapi import FastAPI
 from fastapi.responses import HTMLResponse, JSONResponse
 from pydantic import BaseModel
-from datetime import datetime
-import sqlalchemy as sa
-from sqlalchemy.orm import sessionmaker, declarative_base
-
-# --- DB Setup ---
-DB_URL = "sqlite:///./fps.db"
-engine = sa.create_engine(DB_URL, connect_args={"check_same_thread": False})
-Session = sessionmaker(bind=engine)
-Base = declarative_base()
 
-class FPS(Base):
-    __tablename__ = "fps"
-    id = sa.Column(sa.Integer, primary_key=True)
-    value = sa.Column(sa.Float, nullable=False)
-    ts = sa.Column(sa.DateTime, default=datetime.utcnow, index=True)
-
-Base.metadata.create_all(bind=engine)
+SERIES_POINTS = 500
+WINDOWS_KEPT = 2000
 
 app = FastAPI()
 
 class Ingest(BaseModel):
     value: float
 
-# --- Helpers ---
-def keep_rows(db):
-    min_row = db.query(FPS).order_by(FPS.value.asc(), FPS.ts.desc()).first()
-    max_row = db.query(FPS).order_by(FPS.value.desc(), FPS.ts.desc()).first()
-    recent = db.query(FPS).order_by(FPS.ts.desc()).limit(500).all()
-    keep = {r.id for r in recent}
-    if min_row: keep.add(min_row.id)
-    if max_row: keep.add(max_row.id)
-    db.query(FPS).filter(~FPS.id.in_(keep)).delete(synchronize_session=False)
-    db.commit()
+class Sample(BaseModel):
+    t: float                  # seconds since the Unix epoch
+    frame_ms: float
+    stages: Dict[str, float] = {}
+
+class BatchIngest(BaseModel):
+    source: str = "unknown"
+    samples: List[Sample]
+
+# --- Storage ---
+# Endpoints run on a thread pool, so every access goes through the lock
+lock = Lock()
+series = deque(maxlen=SERIES_POINTS)  # (datetime, fps)
+windows = deque(maxlen=WINDOWS_KEPT)
+totals = {"min": None, "max": None}
+
+def add_point(ts, fps):
+    series.append((ts, fps))
+    if totals["min"] is None or fps < totals["min"][1]: totals["min"] = (ts, fps)
+    if totals["max"] is None or fps > totals["max"][1]: totals["max"] = (ts, fps)
+
+def percentile(ordered, p):
+    # Nearest rank
+    if not ordered: return None
+    k = max(0, min(len(ordered) - 1, math.ceil(p * len(ordered) / 100.0) - 1))
+    return ordered[k]
+
+def summarise(batch: BatchIngest):
+    frames = sorted(s.frame_ms for s in batch.samples)
+    mean = sum(frames) / len(frames)
+    stages = {}
+    for s in batch.samples:
+        for name, ms in s.stages.items():
+            stages[name] = stages.get(name, 0.0) + ms
+    return {
+        "source": batch.source,
+        "start": min(s.t for s in batch.samples),
+        "end": max(s.t for s in batch.samples),
+        "count": len(frames),
+        "fps": 1000.0 / mean if mean > 0 else None,
+        "frame_ms": {
+            "mean": mean,
+            "p50": percentile(frames, 50),
+            "p95": percentile(frames, 95),
+            "p99": percentile(frames, 99),
+            "max": frames[-1],
+        },
+        "stages_ms": {name: total / len(frames) for name, total in stages.items()},
+    }
 
 # --- API ---
 @app.post("/ingest")
 def ingest(data: Ingest):
-    db = Session()
-    row = FPS(value=data.value)
-    db.add(row)
-    db.commit()
-    keep_rows(db)
-    db.close()
+    with lock:
+        add_point(datetime.utcnow(), data.value)
     return {"status": "ok"}
 
+@app.post("/ingest/batch")
+def ingest_batch(data: BatchIngest):
+    if not data.samples:
+        return {"status": "ok", "count": 0}
+    window = summarise(data)
+    with lock:
+        windows.append(window)
+        # One point per window keeps the FPS chart meaningful
+        if window["fps"] is not None:
+            add_point(datetime.utcfromtimestamp(window["end"]), window["fps"])
+    return {"status": "ok", "count": window["count"]}
+
 @app.post("/clear")
 def clear_data():
-    db = Session()
-    db.query(FPS).delete()
-    db.commit()
-    db.close()
+    with lock:
+        series.clear()
+        windows.clear()
+        totals["min"] = totals["max"] = None
     return {"status": "cleared"}
 
 @app.get("/chart-data")
 def chart_data():
-    db = Session()
-    rows = db.query(FPS).order_by(FPS.ts.asc()).all()
-    values = [r.value for r in rows]
+    with lock:
+        rows = list(series)
+        lo, hi = totals["min"], totals["max"]
+    values = [v for _, v in rows]
 
     stats = {
         "count": len(values),
-        "min": min(values) if values else None,
-        "max": max(values) if values else None,
+        "min": lo[1] if lo else None,
+        "max": hi[1] if hi else None,
         "avg": (sum(values) / len(values)) if values else None,
     }
 
-    series = [{"t": r.ts.isoformat(), "v": r.value} for r in rows]
-    db.close()
-    return JSONResponse({"series": series, **stats})
+    points = [{"t": ts.isoformat(), "v": v} for ts, v in rows]
+    return JSONResponse({"series": points, **stats})
+
+@app.get("/windows")
+def recent_windows(source: Optional[str] = None, limit: int = 100):
+    with lock:
+        rows = [w for w in windows if source is None or w["source"] == source]
+    return JSONResponse({"windows": rows[-limit:] if limit > 0 else []})
 
 # --- UI ---
 @app.get("/", response_class=HTMLResponse)
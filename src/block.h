@@ -18,6 +18,8 @@ enum BlockType {
     SNOW
 };
 
+constexpr int BLOCK_TYPE_COUNT = SNOW + 1;
+
 enum class LogAxis {
     Y = 0,
     X = 1,
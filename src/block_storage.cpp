@@ -0,0 +1,180 @@
+#include "block_storage.h"
+#include <algorithm>
+#include <cstring>
+
+PalettedSection::PalettedSection(size_t blockCount, Block fill) : count(blockCount) {
+    nonAir = (fill.type == AIR) ? 0 : count;
+    palette.push_back(packBlock(fill));
+}
+
+void PalettedSection::fill(Block b) {
+    nonAir = (b.type == AIR) ? 0 : count;
+    bits = 0;
+    shift = 0;
+    mask = 0;
+    palette.assign(1, packBlock(b));
+    std::vector<uint64_t>().swap(data);
+}
+
+void PalettedSection::unpack(uint16_t* out) const {
+    if (bits == 0) {
+        std::fill(out, out + count, palette[0]);
+        return;
+    }
+    // A word at a time; indices never straddle words
+    const size_t perWord = 64 >> shift;
+    for (size_t w = 0, i = 0; i < count; w++) {
+        uint64_t word = data[w];
+        for (size_t k = 0; k < perWord && i < count; k++, i++, word >>= bits) out[i] = palette[word & mask];
+    }
+}
+
+void PalettedSection::writeIndex(size_t index, uint32_t value) {
+    size_t bitPos = index << shift;
+    uint64_t& word = data[bitPos >> 6];
+    unsigned offset = (unsigned)(bitPos & 63);
+    word = (word & ~((uint64_t)mask << offset)) | ((uint64_t)value << offset);
+}
+
+void PalettedSection::repack(uint8_t newShift) {
+    std::vector<uint32_t> indices(count, 0);
+    if (bits != 0) {
+        for (size_t i = 0; i < count; i++) indices[i] = readIndex(i);
+    }
+
+    shift = newShift;
+    bits = (uint8_t)(1u << newShift);
+    mask = (1u << bits) - 1;
+    data.assign((count * bits + 63) / 64, 0);
+    for (size_t i = 0; i < count; i++) {
+        if (indices[i]) writeIndex(i, indices[i]);
+    }
+}
+
+void PalettedSection::set(size_t index, Block b) {
+    uint16_t packed = packBlock(b);
+    if (bits == 0 && palette[0] == packed) return;
+
+    bool wasAir = getType(index) == AIR;
+    if (wasAir != (b.type == AIR)) {
+        if (wasAir) nonAir++;
+        else nonAir--;
+    }
+
+    uint32_t paletteIndex = 0;
+    while (paletteIndex < palette.size() && palette[paletteIndex] != packed) paletteIndex++;
+    if (paletteIndex == palette.size()) palette.push_back(packed);
+
+    if (bits == 0 || palette.size() > (size_t)mask + 1) {
+        uint8_t newShift = (bits == 0) ? 0 : (uint8_t)(shift + 1);
+        while ((1u << (1u << newShift)) < palette.size()) newShift++;
+        repack(newShift);
+    }
+    writeIndex(index, paletteIndex);
+}
+
+void PalettedSection::compact() {
+    if (bits == 0) return;
+
+    std::vector<uint32_t> remap(palette.size(), UINT32_MAX);
+    std::vector<uint16_t> used;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t idx = readIndex(i);
+        if (remap[idx] == UINT32_MAX) {
+            remap[idx] = (uint32_t)used.size();
+            used.push_back(palette[idx]);
+        }
+    }
+
+    if (used.size() == 1) {
+        palette = used;
+        bits = shift = 0;
+        mask = 0;
+        data.clear();
+        data.shrink_to_fit();
+        return;
+    }
+    if (used.size() == palette.size()) return;
+
+    std::vector<uint32_t> indices(count);
+    for (size_t i = 0; i < count; i++) indices[i] = remap[readIndex(i)];
+    palette = used;
+
+    uint8_t newShift = 0;
+    while ((1u << (1u << newShift)) < palette.size()) newShift++;
+    shift = newShift;
+    bits = (uint8_t)(1u << newShift);
+    mask = (1u << bits) - 1;
+    data.assign((count * bits + 63) / 64, 0);
+    data.shrink_to_fit();
+    for (size_t i = 0; i < count; i++) {
+        if (indices[i]) writeIndex(i, indices[i]);
+    }
+}
+
+size_t PalettedSection::memoryBytes() const {
+    return sizeof(*this) + palette.capacity() * sizeof(uint16_t) + data.capacity() * sizeof(uint64_t);
+}
+
+uint64_t PalettedSection::contentHash(uint64_t seed) const {
+    uint64_t h = hashMix(seed, ((uint64_t)bits << 32) | palette.size());
+    for (uint16_t entry : palette) h = hashMix(h, entry);
+    for (uint64_t word : data) h = hashMix(h, word);
+    return h;
+}
+
+void PalettedSection::serialize(std::vector<uint8_t>& out) const {
+    uint16_t header[3] = { (uint16_t)nonAir, (uint16_t)bits, (uint16_t)palette.size() };
+    size_t at = out.size();
+    size_t bytes = sizeof(header) + palette.size() * sizeof(uint16_t) + data.size() * sizeof(uint64_t);
+    out.resize(at + bytes);
+    uint8_t* p = out.data() + at;
+    std::memcpy(p, header, sizeof(header));
+    p += sizeof(header);
+    std::memcpy(p, palette.data(), palette.size() * sizeof(uint16_t));
+    p += palette.size() * sizeof(uint16_t);
+    if (!data.empty()) std::memcpy(p, data.data(), data.size() * sizeof(uint64_t));
+}
+
+bool PalettedSection::deserialize(const uint8_t*& p, const uint8_t* end, size_t blockCount) {
+    uint16_t header[3];
+    if ((size_t)(end - p) < sizeof(header)) return false;
+    std::memcpy(header, p, sizeof(header));
+    size_t newNonAir = header[0];
+    unsigned newBits = header[1];
+    size_t paletteCount = header[2];
+
+    uint8_t newShift = 0;
+    if (newBits != 0) {
+        while (newShift < 5 && (1u << newShift) != newBits) newShift++;
+        if (newShift == 5) return false;
+    }
+    size_t maxPalette = newBits == 0 ? 1 : ((size_t)1 << newBits);
+    if (paletteCount == 0 || paletteCount > maxPalette || newNonAir > blockCount) return false;
+    size_t words = newBits == 0 ? 0 : (blockCount * newBits + 63) / 64;
+    size_t bytes = sizeof(header) + paletteCount * sizeof(uint16_t) + words * sizeof(uint64_t);
+    if ((size_t)(end - p) < bytes) return false;
+
+    PalettedSection loaded;
+    const uint8_t* q = p + sizeof(header);
+    loaded.palette.resize(paletteCount);
+    std::memcpy(loaded.palette.data(), q, paletteCount * sizeof(uint16_t));
+    q += paletteCount * sizeof(uint16_t);
+    loaded.data.resize(words);
+    if (words) std::memcpy(loaded.data.data(), q, words * sizeof(uint64_t));
+
+    loaded.count = blockCount;
+    loaded.nonAir = newNonAir;
+    loaded.bits = (uint8_t)newBits;
+    loaded.shift = newBits == 0 ? 0 : newShift;
+    loaded.mask = newBits == 0 ? 0 : (uint32_t)(((uint64_t)1 << newBits) - 1);
+    if (newBits != 0 && paletteCount < maxPalette) {
+        for (size_t i = 0; i < blockCount; i++) {
+            if (loaded.readIndex(i) >= paletteCount) return false;
+        }
+    }
+
+    *this = std::move(loaded);
+    p += bytes;
+    return true;
+}
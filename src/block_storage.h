@@ -0,0 +1,92 @@
+#pragma once
+#include "block.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Blocks as stored in a palette: type in the low byte, log axis above it
+inline uint16_t packBlock(const Block& b) {
+    return (uint16_t)((unsigned)b.type | ((unsigned)b.axis << 8));
+}
+
+inline Block unpackBlock(uint16_t v) {
+    Block b;
+    b.type = (BlockType)(v & 0xFF);
+    b.axis = (LogAxis)(v >> 8);
+    return b;
+}
+
+// Folds v into a running 64-bit content hash
+inline uint64_t hashMix(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+// Paletted storage for one section of a chunk. A uniform section stores a
+// single palette entry and no index data; otherwise every block is a
+// bit-packed palette index of 1, 2, 4, 8 or 16 bits. Powers of two keep
+// indices from straddling 64-bit words.
+class PalettedSection {
+public:
+    explicit PalettedSection(size_t blockCount = 0, Block fill = Block());
+
+    Block get(size_t index) const {
+        if (bits == 0) return unpackBlock(palette[0]);
+        return unpackBlock(palette[readIndex(index)]);
+    }
+
+    BlockType getType(size_t index) const {
+        if (bits == 0) return (BlockType)(palette[0] & 0xFF);
+        return (BlockType)(palette[readIndex(index)] & 0xFF);
+    }
+
+    // Every block packed (see packBlock), in index order; out holds the
+    // section's block count
+    void unpack(uint16_t* out) const;
+
+    void set(size_t index, Block b);
+    // Makes the section uniform again; frees the index data but keeps the palette's storage
+    void fill(Block b);
+
+    // Drops unused palette entries and collapses to a uniform section when
+    // only one block remains. Call after bulk writes such as terrain.
+    void compact();
+
+    bool isUniform() const { return bits == 0; }
+    bool isEmpty() const { return nonAir == 0; }     // all air
+    bool isFull() const { return nonAir == count; }  // no air at all
+    Block uniformBlock() const { return unpackBlock(palette[0]); }
+    size_t paletteSize() const { return palette.size(); }
+    size_t memoryBytes() const;
+
+    // Hash of the section as stored. Equal sections always hash the same
+    // when their palettes were built the same way, e.g. by the same terrain
+    // or by loading the same record.
+    uint64_t contentHash(uint64_t seed) const;
+
+    // Appends the section as stored, palette and packed indices included
+    void serialize(std::vector<uint8_t>& out) const;
+    // Reads what serialize wrote for a section of blockCount blocks and
+    // advances p. Leaves the section untouched and returns false if the
+    // bytes don't describe a valid section.
+    bool deserialize(const uint8_t*& p, const uint8_t* end, size_t blockCount);
+
+private:
+    uint32_t readIndex(size_t index) const {
+        size_t bitPos = index << shift;
+        return (uint32_t)(data[bitPos >> 6] >> (bitPos & 63)) & mask;
+    }
+    void writeIndex(size_t index, uint32_t value);
+    void repack(uint8_t newShift);
+
+    size_t count = 0;
+    size_t nonAir = 0;
+    uint8_t bits = 0;   // 0 = uniform
+    uint8_t shift = 0;  // log2(bits)
+    uint32_t mask = 0;
+    std::vector<uint16_t> palette;
+    std::vector<uint64_t> data;
+};
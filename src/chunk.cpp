@@ -1,179 +1,505 @@
 #include "chunk.h"
 #include "world.h"
 #include "texture_atlas.h"
+#include <algorithm>
+#include <bitset>
+#include <iterator>
 
-float cubeFaces[6][30] = {
+// Each face is a quad of 4 corners (x y z u v); corners 0-1-2 and 0-2-3
+// form the two triangles, see QUAD_INDEX_PATTERN.
+float cubeFaces[6][20] = {
     // ---------- FRONT -Z ----------
     {
         -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
          0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-
-         0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
+         0.5f, -0.5f, -0.5f,  1.0f, 0.0f
     },
     // ---------- BACK +Z ----------
     {
         -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
          0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
          0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-
-         0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f
+        -0.5f,  0.5f,  0.5f,  0.0f, 1.0f
     },
     // ---------- LEFT -X ----------
     {
-        -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-
         -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
         -0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  1.0f, 1.0f
+        -0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
     },
     // ---------- RIGHT +X ----------
     {
-        0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-        0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-        0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-
-        0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-        0.5f, -0.5f, -0.5f,  0.0f, 0.0f
+         0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
+         0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
+         0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+         0.5f, -0.5f,  0.5f,  1.0f, 0.0f
     },
     // ---------- BOTTOM -Y ----------
     {
         -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
          0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
          0.5f, -0.5f,  0.5f,  1.0f, 1.0f,
-
-         0.5f, -0.5f,  0.5f,  1.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 0.0f
-     },
-     // ---------- TOP +Y ----------
-     {
-         -0.5f,  0.5f, -0.5f,  0.0f, 0.0f,
-          0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-          0.5f,  0.5f, -0.5f,  1.0f, 0.0f,
-
-          0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-         -0.5f,  0.5f, -0.5f,  0.0f, 0.0f,
-         -0.5f,  0.5f,  0.5f,  0.0f, 1.0f
-      }
+        -0.5f, -0.5f,  0.5f,  0.0f, 1.0f
+    },
+    // ---------- TOP +Y ----------
+    {
+        -0.5f,  0.5f, -0.5f,  0.0f, 0.0f,
+        -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
+         0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+         0.5f,  0.5f, -0.5f,  1.0f, 0.0f
+    }
 };
 
 Chunk::Chunk(int cx, int cz, unsigned int w, unsigned int d, unsigned int h)
     : chunkX(cx), chunkZ(cz), width(w), depth(d), height(h) {
-    blocks.resize(width * height * depth);
+    sections.assign((height + SECTION_HEIGHT - 1) / SECTION_HEIGHT, PalettedSection(width * depth * SECTION_HEIGHT));
 }
 
-Block& Chunk::getBlock(int x, int y, int z) {
-    return blocks[x + width * (y + height * z)];
+void Chunk::compact() {
+    for (PalettedSection& s : sections) s.compact();
 }
 
-void Chunk::setBlock(int x, int y, int z, BlockType type) {
-    blocks[x + width * (y + height * z)].type = type;
+size_t Chunk::memoryBytes() const {
+    size_t bytes = sizeof(*this);
+    for (const PalettedSection& s : sections) bytes += s.memoryBytes();
+    bytes += heightmap.capacity() + biomes.capacity();
+    return bytes;
 }
 
-void ChunkMesh::appendFaceWithAtlas(float face[30], int x, int y, int z, int chunkX, int chunkZ,
-                                   int chunkWidth, int chunkDepth, Block& block, int faceIndex) {
-    float worldX = chunkX * chunkWidth + x;
-    float worldZ = chunkZ * chunkDepth + z;
+const unsigned int QUAD_INDEX_PATTERN[INDICES_PER_QUAD] = { 0, 1, 2, 0, 2, 3 };
 
-    AtlasTexture tex = g_textureAtlas.getTexture(block.type, faceIndex);
-    const AtlasConfig& config = g_textureAtlas.getConfig();
+// Per face: u-axis, v-axis and normal axis (0 = x, 1 = y, 2 = z)
+static const int faceAxes[6][3] = {
+    {0, 1, 2}, {0, 1, 2},
+    {2, 1, 0}, {2, 1, 0},
+    {0, 2, 1}, {0, 2, 1}
+};
 
-    float uScale = config.getUScale();
-    float vScale = config.getVScale();
-    float uOffset = g_textureAtlas.getUOffset(tex);
-    float vOffset = g_textureAtlas.getVOffset(tex);
+std::atomic<MeshingMode> g_meshingMode{MeshingMode::Greedy};
 
-    for (int i = 0; i < 6; ++i) {
-        float u = face[i*5 + 3];
-        float v = face[i*5 + 4];
+void ChunkMesh::appendFaceWithAtlas(std::vector<PackedVertex>& out, int faceIndex, int x, int y, int z,
+                                    int du, int dv, const Block& block) {
+    const float* face = cubeFaces[faceIndex];
+    int base[3] = { x, y, z };
+    int extent[3] = { 1, 1, 1 };
+    extent[faceAxes[faceIndex][0]] = du;
+    extent[faceAxes[faceIndex][1]] = dv;
 
-        // Handle log rotation for wood blocks
-        if (block.type == WOOD) {
-            if (faceIndex < 4) { // Side faces
-                if (block.axis == LogAxis::X) std::swap(u, v);
-                else if (block.axis == LogAxis::Z) u = 1.0f - u;
+    int layer = g_textureAtlas.faceLayer(block.type, faceIndex);
+
+    // Handle log rotation for wood blocks
+    int rotation = UV_NONE;
+    if (block.type == WOOD && faceIndex < 4) { // Side faces
+        if (block.axis == LogAxis::X) rotation = UV_SWAP;
+        else if (block.axis == LogAxis::Z) rotation = UV_MIRROR_U;
+    }
+
+    for (int i = 0; i < VERTICES_PER_QUAD; ++i) {
+        // Corner positions are integers: the block at x spans [x - 0.5, x + 0.5],
+        // stored as [x, x + 1] and shifted back in the vertex shader.
+        int p[3];
+        for (int a = 0; a < 3; ++a) {
+            p[a] = base[a] + (face[i*5 + a] > 0.0f ? extent[a] : 0);
+        }
+        int corner = (face[i*5 + 3] > 0.5f ? 1 : 0) | (face[i*5 + 4] > 0.5f ? 2 : 0);
+        out.push_back(packVertex(p[0], p[1], p[2], faceIndex, rotation, corner, layer));
+    }
+}
+
+// Faces only merge when they would be textured identically; the log axis only
+// matters on the rotated side faces of wood.
+static int greedyKey(const Block& block, int faceIndex) {
+    int axis = (block.type == WOOD && faceIndex < 4) ? (int)block.axis : 0;
+    return 1 + (int)block.type + (axis << 5);
+}
+
+static Block greedyBlock(int key) {
+    Block b;
+    b.type = (BlockType)((key - 1) & 31);
+    b.axis = (LogAxis)((key - 1) >> 5);
+    return b;
+}
+
+// Bit x of bits[f][y][z] is set when block (x, y, z) of the section shows
+// face f, i.e. it is solid and its neighbour that way is air
+struct FaceMasks {
+    uint16_t bits[6][SECTION_HEIGHT][MeshInput::WIDTH];
+    uint16_t any[SECTION_HEIGHT][MeshInput::WIDTH];
+    unsigned int count = 0;
+};
+
+// Sixteen blocks per operation: each padded row's solid cells become a bit
+// row, and a face shows where a row has a bit its neighbouring row (or
+// itself shifted) lacks
+static void buildFaceMasks(const MeshInput& in, FaceMasks& m) {
+    const int S = MeshInput::SIZE;
+    uint32_t solid[MeshInput::HEIGHT][MeshInput::SIZE];
+    for (int py = 0; py < in.layers + 2; py++) {
+        for (int pz = 0; pz < S; pz++) {
+            const uint16_t* row = &in.blocks[S * (pz + S * py)];
+            uint32_t bits = 0;
+            for (int px = 0; px < S; px++) bits |= (uint32_t)((row[px] & 0xFF) != AIR) << px;
+            solid[py][pz] = bits;
+        }
+    }
+
+    // Bit x of the result is set where cell x of the padded row is air
+    auto open = [](uint32_t row) { return (uint16_t)(~(row >> 1) & 0xFFFF); };
+    m.count = 0;
+    for (int y = 0; y < in.layers; y++) {
+        for (int z = 0; z < MeshInput::WIDTH; z++) {
+            uint32_t row = solid[y + 1][z + 1];
+            uint16_t self = (uint16_t)((row >> 1) & 0xFFFF);
+            uint16_t f[6];
+            f[0] = self & open(solid[y + 1][z]);
+            f[1] = self & open(solid[y + 1][z + 2]);
+            f[2] = self & (uint16_t)(~row & 0xFFFF);
+            f[3] = self & (uint16_t)(~(row >> 2) & 0xFFFF);
+            f[4] = self & open(solid[y][z + 1]);
+            f[5] = self & open(solid[y + 2][z + 1]);
+            uint16_t any = 0;
+            for (int i = 0; i < 6; i++) {
+                m.bits[i][y][z] = f[i];
+                m.count += (unsigned int)std::bitset<16>(f[i]).count();
+                any |= f[i];
             }
+            m.any[y][z] = any;
         }
+    }
+}
 
-        vertices.push_back(face[i*5 + 0] + worldX);
-        vertices.push_back(face[i*5 + 1] + y);
-        vertices.push_back(face[i*5 + 2] + worldZ);
-        vertices.push_back(u * uScale + uOffset);
-        vertices.push_back(v * vScale + vOffset);
+static void buildPerFace(std::vector<PackedVertex>& out, const MeshInput& in, const FaceMasks& m, int y0,
+                         MeshStats& stats) {
+    for (int x = 0; x < MeshInput::WIDTH; x++) {
+        const uint16_t bit = (uint16_t)(1u << x);
+        for (int y = 0; y < in.layers; y++) {
+            for (int z = 0; z < MeshInput::WIDTH; z++) {
+                if (!(m.any[y][z] & bit)) continue;
+                Block block = in.block(x, y, z);
+                for (int f = 0; f < 6; f++) {
+                    if (!(m.bits[f][y][z] & bit)) continue;
+                    ChunkMesh::appendFaceWithAtlas(out, f, x, y0 + y, z, 1, 1, block);
+                    stats.faces++;
+                    stats.quads++;
+                }
+            }
+        }
     }
 }
 
-void ChunkMesh::uploadToGPU(const std::vector<float>& newVertices) {
-    if (VAO == 0) glGenVertexArrays(1, &VAO);
-    if (VBO == 0) glGenBuffers(1, &VBO);
+static void buildGreedy(std::vector<PackedVertex>& out, const MeshInput& in, const FaceMasks& m, int y0,
+                        MeshStats& stats) {
+    const int dims[3] = { MeshInput::WIDTH, in.layers, MeshInput::WIDTH };
+    std::vector<int> mask;
+
+    for (int f = 0; f < 6; f++) {
+        const int ua = faceAxes[f][0];
+        const int va = faceAxes[f][1];
+        const int na = faceAxes[f][2];
+        const int nu = dims[ua];
+        const int nv = dims[va];
+        mask.assign(nu * nv, 0);
 
-    vertices = newVertices;
+        for (int s = 0; s < dims[na]; s++) {
+            // Mask of visible faces in this slice
+            int visible = 0;
+            int p[3];
+            p[na] = s;
+            for (int v = 0; v < nv; v++) {
+                p[va] = v;
+                for (int u = 0; u < nu; u++) {
+                    p[ua] = u;
+                    int key = 0;
+                    if (m.bits[f][p[1]][p[2]] >> p[0] & 1) {
+                        key = greedyKey(in.block(p[0], p[1], p[2]), f);
+                        visible++;
+                    }
+                    mask[u + v * nu] = key;
+                }
+            }
+            if (visible == 0) continue;
+            stats.faces += visible;
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+            // Merge runs along u, then grow the run along v while whole rows match
+            for (int v = 0; v < nv; v++) {
+                for (int u = 0; u < nu; ) {
+                    int key = mask[u + v * nu];
+                    if (key == 0) { u++; continue; }
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-}
+                    int w = 1;
+                    while (u + w < nu && mask[u + w + v * nu] == key) w++;
+
+                    int h = 1;
+                    for (; v + h < nv; h++) {
+                        bool rowMatches = true;
+                        for (int k = 0; k < w; k++) {
+                            if (mask[u + k + (v + h) * nu] != key) { rowMatches = false; break; }
+                        }
+                        if (!rowMatches) break;
+                    }
 
-void ChunkMesh::draw() {
-    glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 5);
+                    for (int dy = 0; dy < h; dy++) {
+                        for (int k = 0; k < w; k++) mask[u + k + (v + dy) * nu] = 0;
+                    }
+
+                    p[ua] = u;
+                    p[va] = v;
+                    ChunkMesh::appendFaceWithAtlas(out, f, p[0], y0 + p[1], p[2], w, h, greedyBlock(key));
+                    stats.quads++;
+                    u += w;
+                }
+            }
+        }
+    }
 }
 
-std::vector<float> ChunkMesh::buildVertices(Chunk& chunk, ChunkManager* manager) {
-    ChunkMesh tmp;
-    tmp.vertices.clear();
+// Bump whenever buildVertices would produce different vertices for the
+// same blocks, so cached meshes from older builds stop matching
+constexpr uint64_t MESHER_VERSION = 1;
+
+// Copies a face of a neighbouring section into the border: cell (a, b)
+// comes from storage index from + a * fromA + b * fromB and lands at
+// to + a * toA + b * toB
+static void copyBorder(uint16_t* blocks, const PalettedSection& section, int from, int fromA, int fromB,
+                       int to, int toA, int toB, int countB) {
+    const int W = MeshInput::WIDTH;
+    if (section.isUniform()) {
+        uint16_t packed = packBlock(section.uniformBlock());
+        for (int b = 0; b < countB; b++)
+            for (int a = 0; a < W; a++) blocks[to + a * toA + b * toB] = packed;
+        return;
+    }
+    for (int b = 0; b < countB; b++)
+        for (int a = 0; a < W; a++) blocks[to + a * toA + b * toB] = packBlock(section.get(from + a * fromA + b * fromB));
+}
 
-    ManagedChunk* neighborLeft  = manager->getChunk(chunk.chunkX - 1, chunk.chunkZ);
-    ManagedChunk* neighborRight = manager->getChunk(chunk.chunkX + 1, chunk.chunkZ);
-    ManagedChunk* neighborFront = manager->getChunk(chunk.chunkX, chunk.chunkZ - 1);
-    ManagedChunk* neighborBack  = manager->getChunk(chunk.chunkX, chunk.chunkZ + 1);
+void MeshInput::capture(const Chunk& chunk, ChunkManager& manager, int s, MeshingMode meshingMode) {
+    const int W = WIDTH;
+    section = s;
+    mode = meshingMode;
+    const int y0 = s * SECTION_HEIGHT;
+    layers = std::min(SECTION_HEIGHT, (int)chunk.height - y0);
+    empty = chunk.sectionEmpty(s);
+    full = chunk.sectionFull(s);
+    uint64_t seed = hashMix(hashMix(MESHER_VERSION, (uint64_t)mode), g_textureAtlas.layoutHash());
+    sectionKey = chunk.sections[s].contentHash(seed);
 
-    auto isAir = [&](int bx, int by, int bz) -> bool {
-        if (by < 0 || by >= (int)chunk.height) return true;
+    std::fill(std::begin(blocks), std::end(blocks), packBlock(Block()));
+    if (!empty) {
+        thread_local std::vector<uint16_t> unpacked;
+        unpacked.resize((size_t)W * W * layers);
+        chunk.sections[s].unpack(unpacked.data());
+        for (int y = 0; y < layers; y++) {
+            for (int z = 0; z < W; z++) std::copy_n(&unpacked[W * (z + W * y)], W, &blocks[index(0, y, z)]);
+        }
+    }
 
-        if (bx < 0)  return !neighborLeft  || neighborLeft->chunk.getBlock(chunk.width-1, by, bz).type == AIR;
-        if (bx >= (int)chunk.width)  return !neighborRight || neighborRight->chunk.getBlock(0, by, bz).type == AIR;
-        if (bz < 0)  return !neighborFront || neighborFront->chunk.getBlock(bx, by, chunk.depth-1).type == AIR;
-        if (bz >= (int)chunk.depth)  return !neighborBack  || neighborBack->chunk.getBlock(bx, by, 0).type == AIR;
+    // Storage index of a block is x + W * (z + W * y)
+    if (s > 0) {
+        copyBorder(blocks, chunk.sections[s - 1], W * W * (SECTION_HEIGHT - 1), 1, W, index(0, -1, 0), 1, SIZE, W);
+    }
+    if (s + 1 < chunk.sectionCount()) {
+        copyBorder(blocks, chunk.sections[s + 1], 0, 1, W, index(0, layers, 0), 1, SIZE, W);
+    }
 
-        return chunk.getBlock(bx, by, bz).type == AIR;
+    auto side = [&](int dx, int dz) -> const PalettedSection* {
+        const ManagedChunk* n = manager.getChunk(chunk.chunkX + dx, chunk.chunkZ + dz);
+        return n && s < n->chunk.sectionCount() ? &n->chunk.sections[s] : nullptr;
     };
+    if (const PalettedSection* left = side(-1, 0))
+        copyBorder(blocks, *left, W - 1, W, W * W, index(-1, 0, 0), SIZE, SIZE * SIZE, layers);
+    if (const PalettedSection* right = side(1, 0))
+        copyBorder(blocks, *right, 0, W, W * W, index(W, 0, 0), SIZE, SIZE * SIZE, layers);
+    if (const PalettedSection* front = side(0, -1))
+        copyBorder(blocks, *front, W * (W - 1), 1, W * W, index(0, 0, -1), 1, SIZE * SIZE, layers);
+    if (const PalettedSection* back = side(0, 1))
+        copyBorder(blocks, *back, 0, 1, W * W, index(0, 0, W), 1, SIZE * SIZE, layers);
+}
 
-    for (int x = 0; x < (int)chunk.width; x++) {
-        for (int y = 0; y < (int)chunk.height; y++) {
-            for (int z = 0; z < (int)chunk.depth; z++) {
-                Block& block = chunk.getBlock(x, y, z);
-                if (block.type == AIR) continue;
-
-                if (isAir(x, y, z - 1)) tmp.appendFaceWithAtlas(cubeFaces[0], x, y, z, chunk.chunkX, chunk.chunkZ, chunk.width, chunk.depth, block, 0);
-                if (isAir(x, y, z + 1)) tmp.appendFaceWithAtlas(cubeFaces[1], x, y, z, chunk.chunkX, chunk.chunkZ, chunk.width, chunk.depth, block, 1);
-                if (isAir(x - 1, y, z)) tmp.appendFaceWithAtlas(cubeFaces[2], x, y, z, chunk.chunkX, chunk.chunkZ, chunk.width, chunk.depth, block, 2);
-                if (isAir(x + 1, y, z)) tmp.appendFaceWithAtlas(cubeFaces[3], x, y, z, chunk.chunkX, chunk.chunkZ, chunk.width, chunk.depth, block, 3);
-                if (isAir(x, y - 1, z)) tmp.appendFaceWithAtlas(cubeFaces[4], x, y, z, chunk.chunkX, chunk.chunkZ, chunk.width, chunk.depth, block, 4);
-                if (isAir(x, y + 1, z)) tmp.appendFaceWithAtlas(cubeFaces[5], x, y, z, chunk.chunkX, chunk.chunkZ, chunk.width, chunk.depth, block, 5);
+// Flood fills the air of a section and records which faces each pocket
+// touches
+static uint16_t computeVisibility(const MeshInput& in) {
+    if (in.empty) return VISIBILITY_ALL;
+    if (in.full) return 0;
+
+    const int w = MeshInput::WIDTH;
+    const int d = MeshInput::WIDTH;
+    const int h = in.layers;
+    thread_local std::vector<uint8_t> visited;
+    thread_local std::vector<int> stack;
+    visited.assign((size_t)w * d * h, 0);
+
+    uint16_t visibility = 0;
+    for (int start = 0; start < w * d * h; start++) {
+        if (visited[start]) continue;
+        visited[start] = 1;
+        if (!in.air(start % w, start / (w * d), (start / w) % d)) continue;
+
+        int faces = 0;
+        stack.clear();
+        stack.push_back(start);
+        while (!stack.empty()) {
+            int i = stack.back();
+            stack.pop_back();
+            int x = i % w;
+            int z = (i / w) % d;
+            int y = i / (w * d);
+            if (z == 0)     faces |= 1 << 0;
+            if (z == d - 1) faces |= 1 << 1;
+            if (x == 0)     faces |= 1 << 2;
+            if (x == w - 1) faces |= 1 << 3;
+            if (y == 0)     faces |= 1 << 4;
+            if (y == h - 1) faces |= 1 << 5;
+
+            auto visit = [&](int nx, int ny, int nz) {
+                int n = nx + w * (nz + d * ny);
+                if (visited[n]) return;
+                visited[n] = 1;
+                if (in.air(nx, ny, nz)) stack.push_back(n);
+            };
+            if (z > 0)     visit(x, y, z - 1);
+            if (z < d - 1) visit(x, y, z + 1);
+            if (x > 0)     visit(x - 1, y, z);
+            if (x < w - 1) visit(x + 1, y, z);
+            if (y > 0)     visit(x, y - 1, z);
+            if (y < h - 1) visit(x, y + 1, z);
+        }
+
+        for (int a = 0; a < 6; a++) {
+            for (int b = a + 1; b < 6; b++) {
+                if ((faces >> a & 1) && (faces >> b & 1)) visibility |= (uint16_t)(1u << visibilityBit(a, b));
             }
         }
+        if (visibility == VISIBILITY_ALL) break;
+    }
+    return visibility;
+}
+
+uint64_t ChunkMesh::cacheKey(const MeshInput& in) {
+    uint64_t h = in.sectionKey;
+
+    // Outside the section the mesh only depends on which blocks are air
+    uint64_t bits = 0;
+    int bitCount = 0;
+    auto add = [&](bool air) {
+        bits |= (uint64_t)air << bitCount;
+        if (++bitCount == 64) {
+            h = hashMix(h, bits);
+            bits = 0;
+            bitCount = 0;
+        }
+    };
+    const int w = MeshInput::WIDTH;
+    const int d = MeshInput::WIDTH;
+    for (int z = 0; z < d; z++) {
+        for (int x = 0; x < w; x++) {
+            add(in.air(x, -1, z));
+            add(in.air(x, in.layers, z));
+        }
+    }
+    for (int y = 0; y < in.layers; y++) {
+        for (int z = 0; z < d; z++) {
+            add(in.air(-1, y, z));
+            add(in.air(w, y, z));
+        }
+        for (int x = 0; x < w; x++) {
+            add(in.air(x, y, -1));
+            add(in.air(x, y, d));
+        }
+    }
+    return hashMix(h, bits);
+}
+
+void ChunkMesh::buildVertices(const MeshInput& input, std::vector<PackedVertex>& out, MeshStats* outStats,
+                              uint64_t* outKey) {
+    out.clear();
+    if (outStats) *outStats = MeshStats();
+
+    if (outKey) *outKey = cacheKey(input);
+    const uint16_t visibility = computeVisibility(input);
+    if (outStats) outStats->visibility = visibility;
+
+    if (input.empty) return;
+
+    thread_local FaceMasks masks;
+    buildFaceMasks(input, masks);
+    if (masks.count == 0) return;
+
+    const int y0 = input.section * SECTION_HEIGHT;
+    MeshStats stats;
+    stats.visibility = visibility;
+    if (input.mode == MeshingMode::Greedy) {
+        buildGreedy(out, input, masks, y0, stats);
+    } else {
+        buildPerFace(out, input, masks, y0, stats);
+    }
+    if (!out.empty()) {
+        stats.minY = 255;
+        for (PackedVertex v : out) {
+            unsigned int y = (unsigned int)unpackVertexY(v);
+            stats.minY = std::min(stats.minY, y);
+            stats.maxY = std::max(stats.maxY, y);
+        }
     }
+    if (outStats) *outStats = stats;
+}
 
-    return std::move(tmp.vertices);
+void ChunkMesh::buildVertices(Chunk& chunk, ChunkManager* manager, int section, std::vector<PackedVertex>& out,
+                              MeshStats* outStats, uint64_t* outKey) {
+    thread_local MeshInput input;
+    input.capture(chunk, *manager, section, g_meshingMode.load(std::memory_order_relaxed));
+    buildVertices(input, out, outStats, outKey);
 }
 
-void ChunkMesh::generateMesh(Chunk& chunk, ChunkManager* manager) {
-    auto built = ChunkMesh::buildVertices(chunk, manager);
+void ChunkMesh::generateMesh(Chunk& chunk, ChunkManager* manager, int section) {
+    std::vector<PackedVertex> built;
+    ChunkMesh::buildVertices(chunk, manager, section, built, &stats);
     uploadToGPU(built);
 }
 
-ManagedChunk::ManagedChunk(int cx, int cz) : chunk(cx, cz, 16, 16, 128) {}
\ No newline at end of file
+ManagedChunk::ManagedChunk(int cx, int cz)
+    : chunk(cx, cz, 16, 16, 128), meshes(chunk.sectionCount()), generations(chunk.sectionCount(), 0),
+      jobs(std::make_shared<JobToken>()) {
+    markAllDirty();
+}
+
+void ManagedChunk::reset(int cx, int cz) {
+    id = 0;
+    chunk.chunkX = cx;
+    chunk.chunkZ = cz;
+    for (PalettedSection& s : chunk.sections) s.fill(Block());
+    for (ChunkMesh& mesh : meshes) {
+        mesh.gpu.count = 0;
+        mesh.stats = MeshStats();
+    }
+    state.store(ChunkState::New);
+    queuedSections = 0;
+    urgentSections = 0;
+    inRemeshList = false;
+    unsaved = false;
+    // The old token is cancelled and may still be held by dropped jobs
+    jobs = std::make_shared<JobToken>();
+    // Generations keep counting; results of the old load are already
+    // rejected by id
+    markAllDirty();
+}
+
+void ManagedChunk::markAllDirty() {
+    dirtySections = allSections();
+    for (uint32_t& g : generations) g++;
+}
+
+uint32_t ManagedChunk::markBlockDirty(int y) {
+    int s = y / SECTION_HEIGHT;
+    uint32_t marked = 1u << s;
+    if (y % SECTION_HEIGHT == 0 && s > 0) marked |= 1u << (s - 1);
+    if (y % SECTION_HEIGHT == SECTION_HEIGHT - 1 && s + 1 < chunk.sectionCount()) marked |= 1u << (s + 1);
+
+    for (int i = 0; i < chunk.sectionCount(); i++) {
+        if (marked & (1u << i)) generations[i]++;
+    }
+    dirtySections |= marked;
+    return marked;
+}
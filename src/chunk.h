@@ -1,53 +1,259 @@
 #pragma once
 #include "block.h"
+#include "block_storage.h"
+#include "job_system.h"
 #include <vector>
-#include <GL/glew.h>
+#include <atomic>
+#include <shared_mutex>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <glm/glm.hpp>
 
 struct ChunkManager;
 
-extern float cubeFaces[6][30];
+extern float cubeFaces[6][20];
+
+// Meshes are lists of quads drawn through one shared element buffer
+constexpr int VERTICES_PER_QUAD = 4;
+constexpr int INDICES_PER_QUAD = 6;
+extern const unsigned int QUAD_INDEX_PATTERN[INDICES_PER_QUAD];
+
+// Packed mesh vertex, 32 bits:
+//   bits  0-4  x    chunk-local corner position (0..16)
+//   bits  5-12 y    (0..255)
+//   bits 13-17 z    (0..16)
+//   bits 18-20 face index
+//   bits 21-22 uv rotation (see UvRotation)
+//   bits 23-24 quad corner id
+//   bits 25-31 atlas layer
+// Tile-space uv is derived in the vertex shader from the position and face,
+// world position comes from the per-chunk origin uniform.
+using PackedVertex = uint32_t;
+
+enum UvRotation {
+    UV_NONE = 0,
+    UV_SWAP = 1,     // LogAxis::X side faces
+    UV_MIRROR_U = 2  // LogAxis::Z side faces
+};
+
+inline int unpackVertexY(PackedVertex v) { return (int)((v >> 5) & 255u); }
+
+inline PackedVertex packVertex(int x, int y, int z, int face, int rotation, int corner, int layer) {
+    return (uint32_t)x | ((uint32_t)y << 5) | ((uint32_t)z << 13) | ((uint32_t)face << 18) |
+           ((uint32_t)rotation << 21) | ((uint32_t)corner << 23) | ((uint32_t)layer << 25);
+}
+
+enum class MeshingMode {
+    PerFace = 0,
+    Greedy
+};
+
+// Switchable at runtime; read when a section's mesh is queued.
+extern std::atomic<MeshingMode> g_meshingMode;
+
+// Section visibility graph: bit visibilityBit(a, b) is set when faces a and b
+// (cubeFaces order) are joined by air inside the section, so looking in
+// through one can reveal what lies past the other
+constexpr uint16_t VISIBILITY_ALL = 0x7FFF;
+
+inline int visibilityBit(int a, int b) {
+    if (a > b) std::swap(a, b);
+    return a * (11 - a) / 2 + (b - a - 1);
+}
+
+inline bool facesConnected(uint16_t visibility, int a, int b) {
+    return a == b || (visibility >> visibilityBit(a, b)) & 1;
+}
+
+struct MeshStats {
+    unsigned int faces = 0; // visible block faces (what the per-face path emits)
+    unsigned int quads = 0; // quads emitted by the path that built the mesh
+    unsigned int minY = 0;  // vertical extent of the geometry, in packed
+    unsigned int maxY = 0;  // corner coordinates (world y = value - 0.5)
+    // Filled by the mesher; until a section has been meshed it counts as open
+    uint16_t visibility = VISIBILITY_ALL;
+
+    unsigned int perFaceTriangles() const { return faces * 2; }
+    unsigned int triangles() const { return quads * 2; }
+};
+
+// Chunks store blocks in paletted sections of SECTION_HEIGHT layers
+constexpr int SECTION_HEIGHT = 16;
 
 struct Chunk {
     unsigned int width = 16;
     unsigned int depth = 16;
     unsigned int height = 128;
-    std::vector<Block> blocks;
+    std::vector<PalettedSection> sections;
     int chunkX, chunkZ;
 
+    // Per column (x + width * z), filled by terrain generation so later
+    // stages don't sample the noise again: surface height and BiomeType
+    std::vector<uint8_t> heightmap;
+    std::vector<uint8_t> biomes;
+
+    // Held shared by jobs reading this chunk, exclusive by the main thread
+    // while it writes. setBlock itself does not lock.
+    mutable std::shared_mutex lock;
+
     Chunk(int cx = 0, int cz = 0, unsigned int w = 16, unsigned int d = 16, unsigned int h = 128);
 
-    Block& getBlock(int x, int y, int z);
-    void setBlock(int x, int y, int z, BlockType type);
+    Block getBlock(int x, int y, int z) const {
+        return sections[y / SECTION_HEIGHT].get(sectionIndex(x, y, z));
+    }
+    BlockType getType(int x, int y, int z) const {
+        return sections[y / SECTION_HEIGHT].getType(sectionIndex(x, y, z));
+    }
+    void setBlock(int x, int y, int z, Block block) {
+        sections[y / SECTION_HEIGHT].set(sectionIndex(x, y, z), block);
+    }
+    void setBlock(int x, int y, int z, BlockType type) {
+        Block block;
+        block.type = type;
+        setBlock(x, y, z, block);
+    }
+
+    int sectionCount() const { return (int)sections.size(); }
+    bool sectionEmpty(int s) const { return sections[s].isEmpty(); }
+    bool sectionFull(int s) const { return sections[s].isFull(); }
+
+    void compact();
+    size_t memoryBytes() const;
+
+private:
+    size_t sectionIndex(int x, int y, int z) const {
+        return x + width * (z + depth * (y % SECTION_HEIGHT));
+    }
 };
 
+// A mesh's slot in g_worldBuffer
+struct MeshAllocation {
+    unsigned int offset = 0;   // first vertex in the world buffer
+    unsigned int capacity = 0; // reserved vertices, 0 = no allocation
+    unsigned int count = 0;    // vertices in use
+
+    bool valid() const { return capacity != 0; }
+};
+
+// A mesh written by a worker into g_stagingRing, waiting for its GPU copy
+struct StagingSlice {
+    size_t offset = 0; // bytes into the staging buffer
+    size_t size = 0;   // bytes, 0 = not staged
+
+    bool valid() const { return size != 0; }
+};
+
+// Everything meshing a section reads: its blocks plus a one-block border
+// from the sections above and below and the four side neighbours, packed
+// (see packBlock) so no lookup needs a bounds or neighbour check. Captured
+// on the main thread, the only one writing blocks, when the mesh is queued;
+// mesh workers never read live chunks. Border cells with nothing loaded
+// there are air.
+struct MeshInput {
+    static constexpr int WIDTH = 16; // chunk width and depth, see ManagedChunk
+    static constexpr int SIZE = WIDTH + 2;
+    static constexpr int HEIGHT = SECTION_HEIGHT + 2;
+
+    int section = 0;
+    int layers = 0; // block layers in the section
+    bool empty = true;
+    bool full = false;
+    MeshingMode mode = MeshingMode::Greedy;
+    uint64_t sectionKey = 0; // cacheKey so far: mode, atlas, mesher, the section's storage
+    uint16_t blocks[SIZE * SIZE * HEIGHT];
+
+    void capture(const Chunk& chunk, ChunkManager& manager, int section, MeshingMode mode);
+
+    // x and z in [-1, WIDTH], y in [-1, layers], relative to the section's bottom
+    static int index(int x, int y, int z) { return (x + 1) + SIZE * ((z + 1) + SIZE * (y + 1)); }
+    Block block(int x, int y, int z) const { return unpackBlock(blocks[index(x, y, z)]); }
+    bool air(int x, int y, int z) const { return (blocks[index(x, y, z)] & 0xFF) == AIR; }
+};
+
+// One mesh per chunk section. Only the GPU allocation (and its vertex count)
+// is kept, meshes have no resident CPU copy.
 struct ChunkMesh {
-    std::vector<float> vertices;
-    unsigned int VAO = 0, VBO = 0;
+    MeshAllocation gpu;
+    MeshStats stats;
+
+    ChunkMesh() = default;
+    ChunkMesh(const ChunkMesh&) = delete;
+    ChunkMesh& operator=(const ChunkMesh&) = delete;
+    ~ChunkMesh();
+
+    // Builds the geometry of one section. Replaces the contents of out; pass a
+    // reused buffer to avoid reallocating. outKey receives the cacheKey of
+    // the blocks the mesh was built from.
+    static void buildVertices(const MeshInput& input, std::vector<PackedVertex>& out,
+                              MeshStats* outStats = nullptr, uint64_t* outKey = nullptr);
+    // Captures the section's input and builds it; main thread
+    static void buildVertices(Chunk& chunk, ChunkManager* manager, int section, std::vector<PackedVertex>& out,
+                              MeshStats* outStats = nullptr, uint64_t* outKey = nullptr);
 
-    static std::vector<float> buildVertices(Chunk& chunk, ChunkManager* manager);
+    // Hash of everything buildVertices reads for a section: its blocks,
+    // which blocks around it are air, the meshing mode, the atlas layout and
+    // the mesher version
+    static uint64_t cacheKey(const MeshInput& input);
 
-    void generateMesh(Chunk& chunk, ChunkManager* manager);
+    void generateMesh(Chunk& chunk, ChunkManager* manager, int section);
 
-    void appendFaceWithAtlas(float face[30], int x, int y, int z, int chunkX, int chunkZ,
-                            int chunkWidth, int chunkDepth, Block& block, int faceIndex);
+    // Emits one quad covering du x dv faces starting at block (x, y, z);
+    // du/dv = 1 is a single block face.
+    static void appendFaceWithAtlas(std::vector<PackedVertex>& out, int faceIndex, int x, int y, int z,
+                                    int du, int dv, const Block& block);
+
+    void uploadToGPU(const std::vector<PackedVertex>& newVertices); // prebuild vertex buffer
+    void uploadFromStaging(const StagingSlice& slice, unsigned int vertexCount);
+    unsigned int vertexCount() const { return gpu.count; }
+    size_t quadCount() const { return gpu.count / VERTICES_PER_QUAD; }
+    void draw(const glm::vec3& origin); // queued, see WorldBuffer::submit
+};
 
-    void uploadToGPU(const std::vector<float>& newVertices); // prebuild vertex buffer
-    void draw();
+// Generation pipeline, in order. A stage only starts once the neighbourhood
+// it depends on has reached the previous one, see updateChunks.
+enum class ChunkState : uint8_t {
+    New = 0,
+    TerrainQueued,
+    Terrain,          // blocks installed
+    StructuresQueued, // needs: 3x3 neighbourhood at Terrain
+    Structures,       // trees placed
+    Lit,              // needs: 3x3 neighbourhood at Structures; sections can mesh
 };
 
 struct ManagedChunk {
+    uint32_t id = 0; // unique per load, see ChunkManager::addChunk
     Chunk chunk;
-    ChunkMesh mesh;
+    std::vector<ChunkMesh> meshes; // one per section
 
-    bool terrainGenerated = false;
-    bool structuresGenerated = false;
-    bool meshUploaded = false;
-    bool meshDirty = true;
+    std::atomic<ChunkState> state{ChunkState::New};
 
-    // Async scheduling flags
-    bool inTerrainQueue = false;
-    bool inStructQueue = false;
-    bool inMeshQueue = false;
+    // Bit s = section s
+    uint32_t dirtySections;      // needs a rebuild
+    uint32_t queuedSections = 0; // mesh job in flight
+    uint32_t urgentSections = 0; // edited by the player, rebuilt on the main thread this frame
+    bool inRemeshList = false;   // see ChunkManager::requestRemesh
+    bool unsaved = false;        // blocks differ from what is on disk
+
+    // Bumped whenever a section's blocks change; mesh results built from an
+    // older generation are dropped instead of uploaded
+    std::vector<uint32_t> generations;
+
+    JobTokenPtr jobs;
 
     ManagedChunk(int cx, int cz);
-};
\ No newline at end of file
+    // Readies a pooled chunk for another load at (cx, cz). Blocks go back to
+    // air; the meshes keep their world buffer slots so the first upload of
+    // the new load usually fits without allocating.
+    void reset(int cx, int cz);
+
+    bool reached(ChunkState s) const { return state.load() >= s; }
+    // Moves from one state to the next; fails if the chunk is not in from
+    bool advance(ChunkState from, ChunkState to) { return state.compare_exchange_strong(from, to); }
+
+    uint32_t allSections() const { return (1u << chunk.sectionCount()) - 1; }
+    void markAllDirty();
+    // Marks the section holding y, plus the one it borders if y is on its
+    // edge. Returns the sections marked.
+    uint32_t markBlockDirty(int y);
+};
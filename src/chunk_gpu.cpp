@@ -0,0 +1,49 @@
+#include "chunk.h"
+#include "world_buffer.h"
+
+// The GL side of chunk meshes. Headless builds link chunk_gpu_null.cpp
+// instead.
+
+static GLuint s_quadIndexBuffer = 0;
+static size_t s_quadIndexCapacity = 0;
+
+GLuint ensureQuadIndexBuffer(size_t quadCount) {
+    if (s_quadIndexBuffer != 0 && quadCount <= s_quadIndexCapacity) return s_quadIndexBuffer;
+
+    // Pre-generate enough for a typical chunk up front, then grow by doubling
+    size_t capacity = s_quadIndexCapacity ? s_quadIndexCapacity : 65536;
+    while (capacity < quadCount) capacity *= 2;
+
+    std::vector<unsigned int> indices(capacity * INDICES_PER_QUAD);
+    for (size_t q = 0; q < capacity; q++) {
+        for (int i = 0; i < INDICES_PER_QUAD; i++) {
+            indices[q * INDICES_PER_QUAD + i] = (unsigned int)(q * VERTICES_PER_QUAD) + QUAD_INDEX_PATTERN[i];
+        }
+    }
+
+    // Upload through the copy target so no VAO's element binding is touched
+    if (s_quadIndexBuffer == 0) glGenBuffers(1, &s_quadIndexBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, s_quadIndexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    s_quadIndexCapacity = capacity;
+    return s_quadIndexBuffer;
+}
+
+ChunkMesh::~ChunkMesh() {
+    g_worldBuffer.release(gpu);
+}
+
+void ChunkMesh::uploadToGPU(const std::vector<PackedVertex>& newVertices) {
+    g_worldBuffer.upload(gpu, newVertices.data(), (unsigned int)newVertices.size());
+}
+
+void ChunkMesh::uploadFromStaging(const StagingSlice& slice, unsigned int count) {
+    g_worldBuffer.copyFromStaging(gpu, g_stagingRing.buffer(), slice.offset, count);
+    g_stagingRing.release(slice);
+}
+
+void ChunkMesh::draw(const glm::vec3& origin) {
+    g_worldBuffer.addDraw(gpu, origin);
+}
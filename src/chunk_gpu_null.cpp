@@ -0,0 +1,18 @@
+#include "chunk.h"
+
+// Stands in for chunk_gpu.cpp in builds without a GL context (voxel_bench):
+// meshes are built but never leave the CPU.
+
+ChunkMesh::~ChunkMesh() {
+}
+
+void ChunkMesh::uploadToGPU(const std::vector<PackedVertex>& newVertices) {
+    gpu.count = (unsigned int)newVertices.size();
+}
+
+void ChunkMesh::uploadFromStaging(const StagingSlice&, unsigned int count) {
+    gpu.count = count;
+}
+
+void ChunkMesh::draw(const glm::vec3&) {
+}
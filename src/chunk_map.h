@@ -0,0 +1,131 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct ManagedChunk;
+
+// Flat open-addressing map from chunk coordinates to chunks. Both
+// coordinates are packed into one 64-bit key and mixed with the murmur3
+// finalizer, so neighbouring chunks land in unrelated slots. Linear probing,
+// and removal shifts the following run back instead of leaving tombstones,
+// so a lookup never walks further than the cluster it hashes into.
+class ChunkMap {
+public:
+    struct Slot {
+        uint64_t key = 0;
+        ManagedChunk* chunk = nullptr; // nullptr marks an empty slot
+    };
+
+    static uint64_t packKey(int cx, int cz) {
+        return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cz;
+    }
+    static int keyX(uint64_t key) { return (int)(uint32_t)(key >> 32); }
+    static int keyZ(uint64_t key) { return (int)(uint32_t)key; }
+
+    explicit ChunkMap(size_t initialCapacity = 256) {
+        size_t n = 16;
+        while (n < initialCapacity) n <<= 1;
+        slots.resize(n);
+        mask = n - 1;
+    }
+
+    ManagedChunk* find(int cx, int cz) const {
+        uint64_t key = packKey(cx, cz);
+        for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+            const Slot& s = slots[i];
+            if (!s.chunk) return nullptr;
+            if (s.key == key) return s.chunk;
+        }
+    }
+
+    // Replaces any chunk already stored under (cx, cz)
+    void insert(int cx, int cz, ManagedChunk* chunk) {
+        // Kept at most half full so probe runs stay short
+        if ((count + 1) * 2 > slots.size()) grow();
+        place(packKey(cx, cz), chunk);
+    }
+
+    // Returns the removed chunk, or nullptr if there was none
+    ManagedChunk* erase(int cx, int cz) {
+        uint64_t key = packKey(cx, cz);
+        size_t i = hash(key) & mask;
+        while (slots[i].chunk && slots[i].key != key) i = (i + 1) & mask;
+        ManagedChunk* removed = slots[i].chunk;
+        if (!removed) return nullptr;
+
+        // Pull back every later entry of the run that may no longer be
+        // reachable from its home slot across the hole
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask; slots[j].chunk; j = (j + 1) & mask) {
+            size_t home = hash(slots[j].key) & mask;
+            if (((j - home) & mask) >= ((j - hole) & mask)) {
+                slots[hole] = slots[j];
+                hole = j;
+            }
+        }
+        slots[hole] = Slot();
+        count--;
+        return removed;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Visits occupied slots only. Don't insert or erase while iterating.
+    class iterator {
+    public:
+        iterator(const Slot* p, const Slot* end) : p(p), end(end) { skip(); }
+        const Slot& operator*() const { return *p; }
+        const Slot* operator->() const { return p; }
+        iterator& operator++() {
+            ++p;
+            skip();
+            return *this;
+        }
+        bool operator!=(const iterator& o) const { return p != o.p; }
+        bool operator==(const iterator& o) const { return p == o.p; }
+
+    private:
+        void skip() {
+            while (p != end && !p->chunk) ++p;
+        }
+        const Slot* p;
+        const Slot* end;
+    };
+
+    iterator begin() const { return iterator(slots.data(), slots.data() + slots.size()); }
+    iterator end() const { return iterator(slots.data() + slots.size(), slots.data() + slots.size()); }
+
+private:
+    static size_t hash(uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return (size_t)k;
+    }
+
+    void place(uint64_t key, ManagedChunk* chunk) {
+        size_t i = hash(key) & mask;
+        while (slots[i].chunk && slots[i].key != key) i = (i + 1) & mask;
+        if (!slots[i].chunk) count++;
+        slots[i].key = key;
+        slots[i].chunk = chunk;
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        mask = slots.size() - 1;
+        count = 0;
+        for (const Slot& s : old) {
+            if (s.chunk) place(s.key, s.chunk);
+        }
+    }
+
+    std::vector<Slot> slots;
+    size_t mask = 0;
+    size_t count = 0;
+};
@@ -0,0 +1,68 @@
+#include "frame_pacer.h"
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+using namespace std::chrono;
+
+static const FramePacer::Clock::duration MIN_SLACK = microseconds(250);
+static const FramePacer::Clock::duration MAX_SLACK = milliseconds(4);
+
+FramePacer::FramePacer() : deadline(Clock::now()), slack(milliseconds(1)) {
+#ifdef _WIN32
+    // Plain waits round up to the 15.6 ms scheduler tick
+    timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+}
+
+FramePacer::~FramePacer() {
+#ifdef _WIN32
+    if (timer) CloseHandle(timer);
+#endif
+}
+
+void FramePacer::sleepUntil(Clock::time_point t) {
+#ifdef _WIN32
+    if (timer) {
+        LARGE_INTEGER due;
+        due.QuadPart = -(LONGLONG)(duration_cast<nanoseconds>(t - Clock::now()).count() / 100);
+        if (due.QuadPart < 0 && SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE)) {
+            WaitForSingleObject(timer, INFINITE);
+        }
+        return;
+    }
+#endif
+    std::this_thread::sleep_until(t);
+}
+
+void FramePacer::wait(int targetFps) {
+    Clock::time_point now = Clock::now();
+    if (targetFps <= 0) {
+        deadline = now;
+        return;
+    }
+
+    Clock::time_point target = deadline + duration_cast<Clock::duration>(duration<double>(1.0 / targetFps));
+    if (target <= now) {
+        deadline = now;
+        return;
+    }
+
+    Clock::time_point wakeAt = target - slack;
+    if (wakeAt > now) {
+        sleepUntil(wakeAt);
+        // Keep the worst recent oversleep as the margin, decaying slowly
+        Clock::duration late = Clock::now() - wakeAt;
+        slack = std::min(MAX_SLACK, std::max({ MIN_SLACK, late, slack - slack / 64 }));
+    }
+    while (Clock::now() < target) std::this_thread::yield();
+    deadline = target;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <chrono>
+
+// Holds the frame rate to a target without burning a core: sleeps until
+// just before the deadline, then yields in a short spin for the rest. The
+// margin left for the spin follows how late the OS has recently woken us,
+// so it stays small where sleeps are precise.
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    FramePacer();
+    ~FramePacer();
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // Once per frame. Returns one period of targetFps after the previous
+    // frame's deadline, or at once if that has already passed; a late frame
+    // starts a new schedule instead of rushing the next ones. targetFps <= 0
+    // doesn't wait.
+    void wait(int targetFps);
+
+    double slackMillis() const { return std::chrono::duration<double, std::milli>(slack).count(); }
+
+private:
+    void sleepUntil(Clock::time_point t);
+
+    Clock::time_point deadline;
+    Clock::duration slack;
+#ifdef _WIN32
+    void* timer = nullptr; // high resolution waitable timer, if the OS has them
+#endif
+};
@@ -0,0 +1,33 @@
+#include "frustum.h"
+#include <cmath>
+
+void Frustum::update(const glm::mat4& m) {
+    // Gribb/Hartmann plane extraction; glm is column-major so row i is m[c][i]
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    planes[0] = row3 + row0;
+    planes[1] = row3 - row0;
+    planes[2] = row3 + row1;
+    planes[3] = row3 - row1;
+    planes[4] = row3 + row2;
+    planes[5] = row3 - row2;
+
+    for (auto& p : planes) {
+        float len = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+        if (len > 0.0f) p = p / len;
+    }
+}
+
+bool Frustum::intersectsAABB(const glm::vec3& min, const glm::vec3& max) const {
+    for (const auto& p : planes) {
+        // Test the corner furthest along the plane normal
+        glm::vec3 v(p.x >= 0.0f ? max.x : min.x,
+                    p.y >= 0.0f ? max.y : min.y,
+                    p.z >= 0.0f ? max.z : min.z);
+        if (p.x * v.x + p.y * v.y + p.z * v.z + p.w < 0.0f) return false;
+    }
+    return true;
+}
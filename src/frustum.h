@@ -0,0 +1,20 @@
+#pragma once
+#include <glm/glm.hpp>
+
+struct Frustum {
+    // left, right, bottom, top, near, far; xyz = inward normal, w = distance
+    glm::vec4 planes[6];
+
+    void update(const glm::mat4& viewProjection);
+    bool intersectsAABB(const glm::vec3& min, const glm::vec3& max) const;
+};
+
+struct CullStats {
+    unsigned int drawn = 0;
+    unsigned int culledFrustum = 0;
+    unsigned int culledDistance = 0;
+    unsigned int culledOcclusion = 0; // behind terrain, see collectVisibleSections
+    unsigned int empty = 0;
+
+    unsigned int culled() const { return culledFrustum + culledDistance + culledOcclusion; }
+};
@@ -0,0 +1,38 @@
+#include "gpu_timer.h"
+
+void GpuTimer::collect() {
+    for (int i = 0; i < LATENCY; i++) {
+        if (!pending[i]) continue;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) continue;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &ns);
+        millis = (float)(ns / 1e6);
+        pending[i] = false;
+    }
+}
+
+void GpuTimer::begin() {
+    if (!queries[0]) glGenQueries(LATENCY, queries);
+    collect();
+    if (pending[next]) return;
+    glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    running = true;
+}
+
+void GpuTimer::end() {
+    if (!running) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[next] = true;
+    next = (next + 1) % LATENCY;
+    running = false;
+}
+
+void GpuTimer::shutdown() {
+    if (queries[0]) glDeleteQueries(LATENCY, queries);
+    for (int i = 0; i < LATENCY; i++) {
+        queries[i] = 0;
+        pending[i] = false;
+    }
+}
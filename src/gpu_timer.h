@@ -0,0 +1,27 @@
+#pragma once
+#include <GL/glew.h>
+
+// GPU time of one pass per frame, from GL_TIME_ELAPSED queries. Results are
+// read back a few frames late, without stalling; a frame whose query slot
+// is still busy just isn't timed. GL thread only.
+class GpuTimer {
+public:
+    void begin();
+    void end();
+    void shutdown();
+
+    // Latest result
+    float lastMillis() const { return millis; }
+
+private:
+    static constexpr int LATENCY = 4;
+
+    // Picks up every finished query
+    void collect();
+
+    GLuint queries[LATENCY] = {};
+    bool pending[LATENCY] = {};
+    int next = 0;
+    bool running = false;
+    float millis = 0.0f;
+};
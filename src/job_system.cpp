@@ -0,0 +1,149 @@
+#include "job_system.h"
+#include "profiler.h"
+
+// Index of the worker running on this thread, -1 outside the pool
+static thread_local int t_workerIndex = -1;
+
+void JobDeque::push(Job&& job) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (count == ring.size()) {
+        std::vector<Job> grown(ring.size() * 2);
+        for (size_t i = 0; i < count; i++) grown[i] = std::move(ring[(head + i) % ring.size()]);
+        ring.swap(grown);
+        head = 0;
+    }
+    ring[(head + count) % ring.size()] = std::move(job);
+    count++;
+}
+
+bool JobDeque::popFront(Job& out) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (count == 0) return false;
+    out = std::move(ring[head]);
+    head = (head + 1) % ring.size();
+    count--;
+    return true;
+}
+
+bool JobDeque::popBack(Job& out) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (count == 0) return false;
+    out = std::move(ring[(head + count - 1) % ring.size()]);
+    count--;
+    return true;
+}
+
+size_t JobDeque::size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return count;
+}
+
+JobSystem::JobSystem(size_t threadCount) {
+    if (threadCount == 0) threadCount = 1;
+    for (size_t i = 0; i < threadCount; ++i) workers.emplace_back(new Worker());
+    // Start threads only once every deque exists, since workers steal from all of them
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers[i]->thread = std::thread([this, i]{ this->workerLoop(i); });
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMtx);
+        stop.store(true);
+    }
+    wake.notify_all();
+    for (auto& w : workers) if (w->thread.joinable()) w->thread.join();
+}
+
+void JobSystem::submit(JobPriority priority, Job job) {
+    size_t target = (t_workerIndex >= 0) ? (size_t)t_workerIndex
+                                         : nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+    workers[target]->lanes[(int)priority].push(std::move(job));
+    {
+        std::lock_guard<std::mutex> lock(sleepMtx);
+        pending.fetch_add(1);
+    }
+    wake.notify_one();
+}
+
+void JobSystem::waitIdle() {
+    std::unique_lock<std::mutex> lock(sleepMtx);
+    idle.wait(lock, [this]{ return pending.load() == 0 && running.load() == 0; });
+}
+
+size_t JobSystem::pendingCount(JobPriority priority) const {
+    size_t total = 0;
+    for (auto& w : workers) total += w->lanes[(int)priority].size();
+    return total;
+}
+
+bool JobSystem::findJob(size_t index, Job& out) {
+    const size_t n = workers.size();
+    for (int lane = 0; lane < (int)JobPriority::Count; lane++) {
+        if (workers[index]->lanes[lane].popFront(out)) return true;
+        for (size_t i = 1; i < n; i++) {
+            if (workers[(index + i) % n]->lanes[lane].popBack(out)) return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::run(Job& job) {
+    JobToken* token = job.token.get();
+    if (token) {
+        // Counted as running before the check, so a chunk whose token reads
+        // idle after cancel() can't have a job that is about to start
+        token->running.fetch_add(1);
+        if (token->cancelled.load()) {
+            token->running.fetch_sub(1);
+            return;
+        }
+    }
+    job();
+    if (token) token->running.fetch_sub(1);
+}
+
+void JobSystem::workerLoop(size_t index) {
+    t_workerIndex = (int)index;
+    g_profiler.setThreadName("worker " + std::to_string(index));
+    while (!stop.load()) {
+        Job job;
+        if (findJob(index, job)) {
+            // Running before it stops being pending, so waitIdle can't see
+            // both at 0 while a job is in hand
+            running.fetch_add(1);
+            pending.fetch_sub(1);
+            run(job);
+            job = Job(); // captures go before the job counts as done
+            if (running.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(sleepMtx);
+                idle.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMtx);
+        wake.wait(lock, [this]{ return stop.load() || pending.load() > 0; });
+    }
+}
+
+static JobSystem* g_jobs = nullptr;
+JobSystem& getJobSystem() {
+    if (!g_jobs) {
+        size_t n = std::thread::hardware_concurrency();
+        size_t threads = (n > 1) ? (n - 1) : 1;
+        g_jobs = new JobSystem(threads);
+    }
+    return *g_jobs;
+}
+
+void initJobSystem(size_t threadCount) {
+    if (!g_jobs) g_jobs = new JobSystem(threadCount > 0 ? threadCount : 1);
+}
+
+void shutdownJobSystem() {
+    if (!g_jobs) return;
+    g_jobs->waitIdle();
+    delete g_jobs;
+    g_jobs = nullptr;
+}
@@ -0,0 +1,174 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Lanes are drained strictly in this order, across all workers
+enum class JobPriority {
+    Urgent = 0, // rebuilds of geometry that is already on screen
+    High,       // meshes
+    Low,        // terrain
+    Count
+};
+
+// Shared by a chunk and every job queued for it. Jobs that have not started
+// when the token is cancelled are dropped unrun; idle() tells when none is
+// still running, after which the chunk can be freed.
+class JobToken {
+public:
+    void cancel() { cancelled.store(true); }
+    bool isCancelled() const { return cancelled.load(); }
+    bool idle() const { return running.load() == 0; }
+
+private:
+    friend class JobSystem;
+    std::atomic<bool> cancelled{false};
+    std::atomic<int> running{0};
+};
+
+using JobTokenPtr = std::shared_ptr<JobToken>;
+
+// A callable stored inline, so queuing a job never allocates. Captures must
+// fit in STORAGE bytes.
+class Job {
+public:
+    static constexpr size_t STORAGE = 48;
+
+    Job() = default;
+
+    template <class F>
+    explicit Job(F&& f, JobTokenPtr jobToken = nullptr) : token(std::move(jobToken)) {
+        using Fn = typename std::decay<F>::type;
+        static_assert(sizeof(Fn) <= STORAGE, "job captures too large for inline storage");
+        static_assert(alignof(Fn) <= alignof(std::max_align_t), "job captures over-aligned");
+        new (storage) Fn(std::forward<F>(f));
+        invoke = [](void* p) { (*static_cast<Fn*>(p))(); };
+        relocate = [](void* dst, void* src) {
+            new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        };
+        destroy = [](void* p) { static_cast<Fn*>(p)->~Fn(); };
+    }
+
+    Job(Job&& other) noexcept { moveFrom(other); }
+    Job& operator=(Job&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+    Job(const Job&) = delete;
+    Job& operator=(const Job&) = delete;
+    ~Job() { reset(); }
+
+    void operator()() { invoke(storage); }
+    explicit operator bool() const { return invoke != nullptr; }
+
+    JobTokenPtr token;
+
+private:
+    void moveFrom(Job& other) {
+        token = std::move(other.token);
+        if (other.invoke) other.relocate(storage, other.storage);
+        invoke = other.invoke;
+        relocate = other.relocate;
+        destroy = other.destroy;
+        other.invoke = nullptr;
+        other.relocate = nullptr;
+        other.destroy = nullptr;
+    }
+    void reset() {
+        if (invoke) destroy(storage);
+        invoke = nullptr;
+        relocate = nullptr;
+        destroy = nullptr;
+        token.reset();
+    }
+
+    alignas(std::max_align_t) unsigned char storage[STORAGE];
+    void (*invoke)(void*) = nullptr;
+    void (*relocate)(void* dst, void* src) = nullptr;
+    void (*destroy)(void*) = nullptr;
+};
+
+// Ring buffer of jobs behind a small lock. The owner takes from the front,
+// thieves take from the back. Grows by doubling, so steady-state pushes
+// don't allocate.
+class JobDeque {
+public:
+    explicit JobDeque(size_t initialCapacity = 256) : ring(initialCapacity) {}
+
+    void push(Job&& job);
+    bool popFront(Job& out);
+    bool popBack(Job& out);
+    size_t size() const;
+
+private:
+    mutable std::mutex mtx;
+    std::vector<Job> ring;
+    size_t head = 0;
+    size_t count = 0;
+};
+
+// Work-stealing pool. Each worker owns one deque per priority lane; jobs
+// submitted from outside the pool are dealt round-robin, jobs submitted by a
+// worker go to its own deque. An idle worker looks through the lanes in
+// priority order, own deque first, then steals from the others.
+class JobSystem {
+public:
+    explicit JobSystem(size_t threadCount);
+    ~JobSystem();
+
+    void submit(JobPriority priority, Job job);
+
+    template <class F>
+    void submit(JobPriority priority, F&& f, JobTokenPtr token = nullptr) {
+        submit(priority, Job(std::forward<F>(f), std::move(token)));
+    }
+
+    size_t workerCount() const { return workers.size(); }
+    // Queued jobs; one a worker has taken counts as running instead
+    size_t pendingCount() const { return pending.load(); }
+    size_t pendingCount(JobPriority priority) const;
+    size_t runningCount() const { return running.load(); }
+
+    // Blocks until nothing is queued or running, jobs that jobs submit
+    // included. Only meaningful once nothing outside the pool submits.
+    void waitIdle();
+
+private:
+    struct Worker {
+        JobDeque lanes[(int)JobPriority::Count];
+        std::thread thread;
+    };
+
+    void workerLoop(size_t index);
+    bool findJob(size_t index, Job& out);
+    void run(Job& job);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> running{0};
+    std::atomic<size_t> nextWorker{0};
+    std::mutex sleepMtx;
+    std::condition_variable wake;
+    std::condition_variable idle; // running dropped to 0
+    std::atomic<bool> stop{false};
+};
+
+JobSystem& getJobSystem();
+// Creates the pool with threadCount workers instead of one per core but one.
+// Only has an effect before the first getJobSystem().
+void initJobSystem(size_t threadCount);
+// Runs what is still queued, then stops and joins the workers. Call before
+// anything jobs use is destroyed (chunks, regions, the completion queues);
+// a later getJobSystem() starts a new pool.
+void shutdownJobSystem();
@@ -0,0 +1,177 @@
+#include "lod.h"
+#include "world.h"
+#include "world_buffer.h"
+#include "job_system.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstdlib>
+
+CompletedLodQueue g_completedLod(1024);
+
+// Enough to keep the workers busy without holding up terrain jobs
+constexpr size_t MAX_LOD_JOBS = 64;
+// ManagedChunk width and depth
+constexpr int CHUNK_SIZE = 16;
+
+int LodTerrain::stepFor(int d, int renderDistance) {
+    if (d <= renderDistance) return 0;
+    if (d <= 2 * renderDistance) return 2;
+    if (d <= 4 * renderDistance) return 4;
+    return 8;
+}
+
+void LodTerrain::release(Tile& tile) {
+    g_worldBuffer.release(tile.gpu);
+    quads -= tile.stats.quads;
+    tile.stats = MeshStats();
+    tile.builtStep = 0;
+}
+
+void LodTerrain::rebuild(int camChunkX, int camChunkZ, int renderDistance, int lodDistance) {
+    for (auto it = tiles.begin(); it != tiles.end();) {
+        Tile& t = it->second;
+        int d = std::max(std::abs(t.cx - camChunkX), std::abs(t.cz - camChunkZ));
+        if (d > lodDistance) {
+            // A job still in flight finds no tile and is dropped
+            release(t);
+            it = tiles.erase(it);
+            continue;
+        }
+        t.step = stepFor(d, renderDistance);
+        ++it;
+    }
+
+    std::vector<std::pair<int, uint64_t>> wanted;
+    for (int dz = -lodDistance; dz <= lodDistance; dz++) {
+        for (int dx = -lodDistance; dx <= lodDistance; dx++) {
+            int step = stepFor(std::max(std::abs(dx), std::abs(dz)), renderDistance);
+            if (step == 0) continue;
+            uint64_t key = ChunkMap::packKey(camChunkX + dx, camChunkZ + dz);
+            Tile& t = tiles[key];
+            t.cx = camChunkX + dx;
+            t.cz = camChunkZ + dz;
+            t.step = step;
+            if (t.builtStep != step) wanted.emplace_back(dx * dx + dz * dz, key);
+        }
+    }
+    std::sort(wanted.begin(), wanted.end());
+    toQueue.clear();
+    for (auto& w : wanted) toQueue.push_back(w.second);
+    nextToQueue = 0;
+
+    // Positions the render distance now covers keep their mesh until their chunk is meshed
+    uncovered.clear();
+    for (auto& entry : tiles) {
+        if (entry.second.step == 0 && entry.second.builtStep != 0) uncovered.push_back(entry.first);
+    }
+}
+
+void LodTerrain::update(ChunkManager& manager, const glm::vec3& pos, int renderDistance, int lodDistance) {
+    PROFILE_SCOPE("lod update");
+    int camChunkX = getChunkCoord(pos.x);
+    int camChunkZ = getChunkCoord(pos.z);
+    if (!hasCenter || camChunkX != centerX || camChunkZ != centerZ || renderDistance != builtRender ||
+        lodDistance != builtLod) {
+        rebuild(camChunkX, camChunkZ, renderDistance, lodDistance);
+        hasCenter = true;
+        centerX = camChunkX;
+        centerZ = camChunkZ;
+        builtRender = renderDistance;
+        builtLod = lodDistance;
+    }
+
+    static std::vector<CompletedLod> batch;
+    batch.clear();
+    g_completedLod.popBatch(batch);
+    for (CompletedLod& r : batch) {
+        inFlight--;
+        auto it = tiles.find(ChunkMap::packKey(r.cx, r.cz));
+        if (it == tiles.end()) continue;
+        Tile& t = it->second;
+        t.queued = false;
+        if (r.step != t.step) {
+            // The rings moved while the job ran
+            if (t.step != 0) toQueue.push_back(it->first);
+            continue;
+        }
+        // Reuses the old allocation when the new mesh fits
+        quads -= t.stats.quads;
+        g_worldBuffer.upload(t.gpu, r.vertices.data(), (unsigned int)r.vertices.size());
+        t.stats = r.stats;
+        t.builtStep = r.step;
+        quads += t.stats.quads;
+    }
+
+    for (size_t i = 0; i < uncovered.size();) {
+        auto it = tiles.find(uncovered[i]);
+        bool done = it == tiles.end() || it->second.step != 0;
+        if (!done) {
+            ManagedChunk* mc = manager.getChunk(it->second.cx, it->second.cz);
+            done = mc && mc->reached(ChunkState::Lit) && mc->dirtySections == 0 && mc->queuedSections == 0;
+            if (done) {
+                release(it->second);
+                tiles.erase(it);
+            }
+        }
+        if (done) {
+            uncovered[i] = uncovered.back();
+            uncovered.pop_back();
+        } else {
+            i++;
+        }
+    }
+
+    while (inFlight < MAX_LOD_JOBS && nextToQueue < toQueue.size()) {
+        auto it = tiles.find(toQueue[nextToQueue++]);
+        if (it == tiles.end()) continue;
+        Tile& t = it->second;
+        if (t.queued || t.step == 0 || t.builtStep == t.step) continue;
+        t.queued = true;
+        inFlight++;
+        int cx = t.cx;
+        int cz = t.cz;
+        int step = t.step;
+        getJobSystem().submit(JobPriority::Low, [cx, cz, step]() {
+            PROFILE_SCOPE("lod job");
+            CompletedLod done;
+            done.cx = cx;
+            done.cz = cz;
+            done.step = step;
+            buildLodMesh(cx, cz, step, done.vertices, &done.stats);
+            g_completedLod.push(std::move(done));
+        });
+    }
+    if (nextToQueue == toQueue.size()) {
+        toQueue.clear();
+        nextToQueue = 0;
+    }
+}
+
+void LodTerrain::draw(const Frustum& frustum, CullStats& stats) {
+    for (auto& entry : tiles) {
+        Tile& t = entry.second;
+        if (t.builtStep == 0) continue;
+        if (!t.gpu.valid()) {
+            stats.empty++;
+            continue;
+        }
+        glm::vec3 origin((float)(t.cx * CHUNK_SIZE), 0.0f, (float)(t.cz * CHUNK_SIZE));
+        glm::vec3 boxMin(origin.x - 0.5f, t.stats.minY - 0.5f, origin.z - 0.5f);
+        glm::vec3 boxMax(origin.x + CHUNK_SIZE - 0.5f, t.stats.maxY - 0.5f, origin.z + CHUNK_SIZE - 0.5f);
+        if (!frustum.intersectsAABB(boxMin, boxMax)) {
+            stats.culledFrustum++;
+            continue;
+        }
+        g_worldBuffer.addDraw(t.gpu, origin);
+        stats.drawn++;
+    }
+}
+
+void LodTerrain::clear() {
+    for (auto& entry : tiles) release(entry.second);
+    tiles.clear();
+    toQueue.clear();
+    nextToQueue = 0;
+    uncovered.clear();
+    hasCenter = false;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "chunk.h"
+#include "frustum.h"
+#include "mpsc_queue.h"
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+struct ChunkManager;
+
+// Far terrain past the full-detail render distance. Every chunk position out
+// to the LOD distance gets a heightmap mesh (buildLodMesh) whose step grows
+// with distance: 2 blocks up to twice the render distance, 4 up to four
+// times, 8 beyond. These need no block storage at all. Inside the render
+// distance a position keeps its LOD mesh until the loaded chunk has all of
+// its sections meshed, so streaming never opens holes.
+class LodTerrain {
+public:
+    // Main thread, after updateChunks. Queues the meshes a new camera chunk
+    // or distance calls for and uploads finished ones.
+    void update(ChunkManager& manager, const glm::vec3& pos, int renderDistance, int lodDistance);
+    // Adds the visible LOD meshes to the world buffer's frame
+    void draw(const Frustum& frustum, CullStats& stats);
+    // GL thread; drops every mesh
+    void clear();
+
+    size_t tileCount() const { return tiles.size(); }
+    unsigned int quadCount() const { return quads; }
+
+    // Step for a chunk at Chebyshev distance d from the camera chunk; 0 inside
+    // the render distance
+    static int stepFor(int d, int renderDistance);
+
+private:
+    struct Tile {
+        int cx = 0;
+        int cz = 0;
+        int step = 0;        // wanted step, 0 = drawn at full detail
+        int builtStep = 0;   // step of the uploaded mesh, 0 = none
+        bool queued = false; // job in flight
+        MeshAllocation gpu;
+        MeshStats stats;
+    };
+
+    void rebuild(int camChunkX, int camChunkZ, int renderDistance, int lodDistance);
+    void release(Tile& tile);
+
+    // ChunkMap::packKey
+    std::unordered_map<uint64_t, Tile> tiles;
+    std::vector<uint64_t> toQueue; // nearest first
+    size_t nextToQueue = 0;
+    // Inside the render distance, still drawn until their chunk is meshed
+    std::vector<uint64_t> uncovered;
+    size_t inFlight = 0;
+    bool hasCenter = false;
+    int centerX = 0;
+    int centerZ = 0;
+    int builtRender = 0;
+    int builtLod = 0;
+    unsigned int quads = 0;
+};
+
+struct CompletedLod {
+    int cx = 0;
+    int cz = 0;
+    int step = 0;
+    std::vector<PackedVertex> vertices;
+    MeshStats stats;
+};
+
+using CompletedLodQueue = MpscQueue<CompletedLod>;
+extern CompletedLodQueue g_completedLod;
@@ -0,0 +1,116 @@
+#include "lz4_block.h"
+#include <cstring>
+
+namespace {
+
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t MAX_OFFSET = 65535;
+// The format requires the last 5 bytes to be literals and the last match
+// to start at least 12 bytes before the end
+constexpr size_t LAST_LITERALS = 5;
+constexpr size_t MATCH_START_LIMIT = 12;
+constexpr int HASH_BITS = 12;
+
+uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+void writeLength(std::vector<uint8_t>& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back((uint8_t)length);
+}
+
+void emitSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount,
+                  size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength - MIN_MATCH;
+    uint8_t token = (uint8_t)((literalCount < 15 ? literalCount : 15) << 4);
+    if (matchLength) token |= (uint8_t)(matchCode < 15 ? matchCode : 15);
+    out.push_back(token);
+    if (literalCount >= 15) writeLength(out, literalCount - 15);
+    out.insert(out.end(), literals, literals + literalCount);
+    if (!matchLength) return;
+    out.push_back((uint8_t)(offset & 0xFF));
+    out.push_back((uint8_t)(offset >> 8));
+    if (matchCode >= 15) writeLength(out, matchCode - 15);
+}
+
+// Reads an extended length; false if it runs past the input
+bool readLength(const uint8_t* src, size_t size, size_t& ip, size_t& length) {
+    uint8_t b;
+    do {
+        if (ip >= size) return false;
+        b = src[ip++];
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+} // namespace
+
+void lz4Compress(const uint8_t* src, size_t size, std::vector<uint8_t>& out) {
+    out.clear();
+    out.reserve(size + size / 255 + 16);
+
+    size_t anchor = 0;
+    if (size > MATCH_START_LIMIT) {
+        std::vector<uint32_t> table((size_t)1 << HASH_BITS, 0);
+        const size_t searchEnd = size - MATCH_START_LIMIT;
+        const size_t matchEnd = size - LAST_LITERALS;
+        size_t i = 0;
+        while (i < searchEnd) {
+            uint32_t sequence = read32(src + i);
+            uint32_t h = (sequence * 2654435761u) >> (32 - HASH_BITS);
+            size_t candidate = table[h];
+            table[h] = (uint32_t)i;
+            if (candidate < i && i - candidate <= MAX_OFFSET && read32(src + candidate) == sequence) {
+                size_t length = MIN_MATCH;
+                while (i + length < matchEnd && src[candidate + length] == src[i + length]) length++;
+                emitSequence(out, src + anchor, i - anchor, i - candidate, length);
+                i += length;
+                anchor = i;
+            } else {
+                i++;
+            }
+        }
+    }
+    emitSequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+bool lz4Decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize) {
+    size_t ip = 0;
+    size_t op = 0;
+    while (ip < size) {
+        uint8_t token = src[ip++];
+
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !readLength(src, size, ip, literalCount)) return false;
+        if (literalCount > size - ip || literalCount > dstSize - op) return false;
+        std::memcpy(dst + op, src + ip, literalCount);
+        ip += literalCount;
+        op += literalCount;
+
+        // The last sequence has literals only
+        if (ip == size) break;
+
+        if (size - ip < 2) return false;
+        size_t offset = (size_t)src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+
+        size_t length = token & 15;
+        if (length == 15 && !readLength(src, size, ip, length)) return false;
+        length += MIN_MATCH;
+        if (length > dstSize - op) return false;
+
+        // Byte by byte: the match may overlap what it is producing
+        const uint8_t* from = dst + op - offset;
+        for (size_t k = 0; k < length; k++) dst[op + k] = from[k];
+        op += length;
+    }
+    return op == dstSize;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compressor and decompressor for the LZ4 block format (no frame header),
+// so region records stay readable by the reference library. The
+// compressor is the simple greedy single-probe variant; paletted chunk data
+// is small and repetitive enough that it gets most of the ratio.
+
+// Replaces out with the compressed form of src[0, size)
+void lz4Compress(const uint8_t* src, size_t size, std::vector<uint8_t>& out);
+
+// Decompresses exactly dstSize bytes into dst. Returns false on malformed
+// input or a size mismatch, without reading or writing out of bounds.
+bool lz4Decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize);
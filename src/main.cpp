@@ -12,6 +12,11 @@
 #include <chrono>
 #include <iomanip>
 #include <exception>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <future>
 
 #include "imgui/imgui.h"
 #include "imgui/backends/imgui_impl_glfw.h"
@@ -21,6 +26,16 @@
 #include "renderer.h"
 #include "world.h"
 #include "chunk.h"
+#include "frustum.h"
+#include "world_buffer.h"
+#include "mesh_upload.h"
+#include "lod.h"
+#include "occlusion.h"
+#include "profiler.h"
+#include "gpu_timer.h"
+#include "job_system.h"
+#include "telemetry.h"
+#include "frame_pacer.h"
 
 Player* g_player = nullptr;
 
@@ -37,6 +52,37 @@ int g_selectedResolution = 0;
 
 bool g_debugHitbox = false;
 
+bool g_remeshAll = false;
+MeshStats g_worldMeshStats;
+CullStats g_cullStats;
+size_t g_blockMemoryBytes = 0;
+int g_chunkPoolCap = 256;
+size_t g_pooledChunks = 0;
+size_t g_regionWrites = 0;
+// Chunks out to which LOD terrain is drawn; at or below the render distance there is none
+int g_lodDistance = 48;
+size_t g_lodTiles = 0;
+unsigned int g_lodQuads = 0;
+CullStats g_lodCullStats;
+bool g_occlusionCulling = true;
+bool g_showProfiler = false;
+
+// Milliseconds from the start of main to each startup milestone; 0 until
+// reached. Playable is the first frame with the 3x3 chunks around the
+// player meshed and uploaded.
+struct StartupTimes {
+    float window = 0.0f;
+    float renderer = 0.0f;
+    float firstFrame = 0.0f;
+    float playable = 0.0f;
+};
+StartupTimes g_startup;
+// Only reported against; nothing waits for it
+const float STARTUP_TARGET_MS = 1000.0f;
+
+UploadBudget g_uploadBudget;
+MeshUploadQueue g_meshUploads;
+
 void WriteCrashLog(const char* reason)
 {
     try {
@@ -182,6 +228,10 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
             togglePauseMenu(window);
         }
 
+        if (key == GLFW_KEY_F3) {
+            g_showProfiler = !g_showProfiler;
+        }
+
         if (key == GLFW_KEY_F && g_player) {
             g_player->toggleMode();
             std::cout << "Movement mode: " << (g_player->mode == MovementMode::FLY ? "FLY" : "NORMAL") << std::endl;
@@ -289,7 +339,7 @@ void renderSettingsMenu(GLFWwindow* window) {
     ImGuiIO& io = ImGui::GetIO();
 
     ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x * 0.5f, io.DisplaySize.y * 0.5f), ImGuiCond_Always, ImVec2(0.5f, 0.5f));
-    ImGui::SetNextWindowSize(ImVec2(500, 500), ImGuiCond_Always);
+    ImGui::SetNextWindowSize(ImVec2(500, 640), ImGuiCond_Always);
 
     ImGui::Begin("Settings", nullptr,
         ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoCollapse);
@@ -319,6 +369,63 @@ void renderSettingsMenu(GLFWwindow* window) {
         g_fpsLimit = fpsValues[fpsIndex];
     }
 
+    ImGui::Spacing();
+
+    ImGui::Text("Meshing:");
+    ImGui::SameLine();
+    const char* meshingItems[] = { "Per-face", "Greedy" };
+    int meshingIndex = (int)g_meshingMode.load();
+    if (ImGui::Combo("##Meshing", &meshingIndex, meshingItems, IM_ARRAYSIZE(meshingItems))) {
+        g_meshingMode.store((MeshingMode)meshingIndex);
+        g_remeshAll = true;
+    }
+    ImGui::Text("Ore noise:");
+    ImGui::SameLine();
+    const char* oreItems[] = { "Exact", "Coarse" };
+    int oreIndex = (int)g_oreNoiseMode.load();
+    if (ImGui::Combo("##OreNoise", &oreIndex, oreItems, IM_ARRAYSIZE(oreItems))) {
+        g_oreNoiseMode.store((OreNoiseMode)oreIndex);
+    }
+    bool skipHidden = g_skipHiddenOres.load();
+    if (ImGui::Checkbox("Skip hidden ores", &skipHidden)) {
+        g_skipHiddenOres.store(skipHidden);
+    }
+    ImGui::SameLine();
+    ImGui::TextDisabled("(?)");
+    if (ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("Applies to chunks generated from now on");
+    }
+    ImGui::Text("Triangles: %u (per-face: %u)",
+                g_worldMeshStats.triangles(), g_worldMeshStats.perFaceTriangles());
+    ImGui::Text("Sections drawn: %u, culled: %u (frustum %u, distance %u, occlusion %u)",
+                g_cullStats.drawn, g_cullStats.culled(), g_cullStats.culledFrustum, g_cullStats.culledDistance,
+                g_cullStats.culledOcclusion);
+    ImGui::Checkbox("Occlusion culling", &g_occlusionCulling);
+    ImGui::Text("LOD: %zu tiles, %u drawn, %u quads", g_lodTiles, g_lodCullStats.drawn, g_lodQuads);
+    ImGui::SliderInt("chunks##LodDistance", &g_lodDistance, 0, 96);
+    ImGui::Text("Block storage: %.2f MiB", g_blockMemoryBytes / (1024.0f * 1024.0f));
+    ImGui::Text("Chunk pool: %zu idle", g_pooledChunks);
+    ImGui::Text("Region writes queued: %zu", g_regionWrites);
+    bool meshCache = g_meshCacheEnabled.load();
+    if (ImGui::Checkbox("Mesh cache", &meshCache)) {
+        g_meshCacheEnabled.store(meshCache);
+    }
+    ImGui::SameLine();
+    ImGui::Text("%u hits, %u built", g_meshCacheHits.load(), g_meshCacheMisses.load());
+    ImGui::SliderInt("cap##ChunkPool", &g_chunkPoolCap, 0, 2048);
+
+    ImGui::Spacing();
+
+    ImGui::Text("Mesh upload budget per frame:");
+    ImGui::SliderInt("KiB##UploadKiB", &g_uploadBudget.maxKiBPerFrame, 64, 32768);
+    ImGui::SliderFloat("ms##UploadMs", &g_uploadBudget.maxMillisPerFrame, 0.25f, 16.0f, "%.2f");
+    const UploadStats& uploads = g_meshUploads.getStats();
+    ImGui::Text("Uploaded: %u (%.1f KiB, %.2f ms), deferred: %u",
+                uploads.uploaded, uploads.bytes / 1024.0f, uploads.millis, uploads.deferred);
+    ImGui::Text("Result queues: mesh %zu (peak %zu), terrain %zu (peak %zu)",
+                g_completedMeshes.depth(), g_completedMeshes.highWaterMark(),
+                g_completedTerrain.depth(), g_completedTerrain.highWaterMark());
+
     ImGui::Spacing();
     ImGui::Spacing();
 
@@ -376,8 +483,71 @@ void renderSettingsMenu(GLFWwindow* window) {
 }
 
 
+// F3. Frame times, where the main thread spent the last frame, and what the
+// streaming pipeline is doing
+void renderProfilerOverlay(ChunkManager& manager, const GpuTimer& gpuDraw, const TelemetryClient* telemetry) {
+    ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowSize(ImVec2(400, 0), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Profiler", &g_showProfiler);
+
+    ImGui::Text("Frame: %.2f ms", g_profiler.lastFrameMillis());
+    ImGui::PlotLines("##FrameTimes", g_profiler.frameHistory(), Profiler::FRAME_HISTORY,
+                     g_profiler.frameHistoryOffset(), nullptr, 0.0f, 33.3f, ImVec2(-1, 60));
+    for (const auto& stage : g_profiler.lastStages()) {
+        ImGui::Text("  %-14s %6.2f ms", stage.first, stage.second);
+    }
+    ImGui::Text("GPU chunk pass: %.2f ms", gpuDraw.lastMillis());
+    ImGui::Text("Startup: first frame %.0f ms, playable %.0f ms (target %.0f)", g_startup.firstFrame,
+                g_startup.playable, STARTUP_TARGET_MS);
+
+    ImGui::Separator();
+    JobSystem& jobs = getJobSystem();
+    ImGui::Text("Jobs queued: %zu (urgent %zu, high %zu, low %zu), %zu workers", jobs.pendingCount(),
+                jobs.pendingCount(JobPriority::Urgent), jobs.pendingCount(JobPriority::High),
+                jobs.pendingCount(JobPriority::Low), jobs.workerCount());
+
+    size_t meshed = 0;
+    size_t inFlight = 0;
+    for (const ChunkMap::Slot& slot : manager.chunks) {
+        const ManagedChunk* mc = slot.chunk;
+        ChunkState state = mc->state.load();
+        if (mc->queuedSections || state == ChunkState::TerrainQueued || state == ChunkState::StructuresQueued) {
+            inFlight++;
+        } else if (state == ChunkState::Lit && !mc->dirtySections) {
+            meshed++;
+        }
+    }
+    ImGui::Text("Chunks: %zu loaded, %zu meshed, %zu in flight", manager.chunks.size(), meshed, inFlight);
+    ImGui::Text("Chunk VBO: %.1f of %.1f MiB, staging %.1f MiB", g_worldBuffer.usedBytes() / (1024.0f * 1024.0f),
+                g_worldBuffer.capacityBytes() / (1024.0f * 1024.0f),
+                g_stagingRing.bytesInUse() / (1024.0f * 1024.0f));
+
+    if (telemetry) {
+        ImGui::Text("Telemetry: %zu sent, %zu dropped%s", telemetry->sentSamples(), telemetry->droppedSamples(),
+                    telemetry->lastPostFailed() ? ", backend unreachable" : "");
+    }
+
+    ImGui::Separator();
+    bool recording = g_profiler.enabled.load();
+    if (ImGui::Checkbox("Record scopes", &recording)) {
+        g_profiler.enabled.store(recording);
+    }
+    static const char* exportStatus = "";
+    if (ImGui::Button("Export Chrome trace")) {
+        exportStatus = g_profiler.exportChromeTrace("trace.json") ? "Wrote trace.json" : "Failed to write trace.json";
+    }
+    ImGui::SameLine();
+    ImGui::Text("%s", exportStatus);
+
+    ImGui::End();
+}
+
 int main(int argc, char* argv[]) {
     InstallCrashHandlers();
+    const auto startupBegin = std::chrono::steady_clock::now();
+    auto sinceStartup = [&]() {
+        return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startupBegin).count();
+    };
 
     unsigned int seed = 0;
     if (argc > 1) {
@@ -391,6 +561,17 @@ int main(int argc, char* argv[]) {
         seed = static_cast<unsigned int>(std::time(nullptr));
     }
 
+    // Created before the window so reading in the spawn area overlaps startup.
+    // Declared before the chunk manager so it outlives it and writes what it saves.
+    const glm::vec3 spawnPosition(0.0f, 75.0f, 0.0f);
+    int renderDistance = 8;
+    RegionStore regionStore("worlds/" + std::to_string(seed));
+    regionStore.prefetch((int)std::floor(spawnPosition.x / 16.0f), (int)std::floor(spawnPosition.z / 16.0f),
+                         renderDistance);
+    // Textures and the program cache are read off disk in the meantime too;
+    // only the upload needs the context
+    std::future<RendererAssets> rendererAssets = std::async(std::launch::async, Renderer::loadAssets);
+
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
         return -1;
@@ -398,7 +579,8 @@ int main(int argc, char* argv[]) {
 
     std::cout << "Using world seed: " << seed << std::endl;
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    // 4.3 enables multi-draw indirect for the world buffer, 3.3 still runs
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -406,6 +588,11 @@ int main(int argc, char* argv[]) {
     const GLFWvidmode* mode = glfwGetVideoMode(monitor);
 
     GLFWwindow* window = glfwCreateWindow(g_windowWidth, g_windowHeight, "Voxel Terrain", nullptr, nullptr);
+    if (!window) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(g_windowWidth, g_windowHeight, "Voxel Terrain", nullptr, nullptr);
+    }
     if (!window) {
         std::cout << "Failed to create window" << std::endl;
         glfwTerminate();
@@ -443,32 +630,59 @@ int main(int argc, char* argv[]) {
     ImGui_ImplOpenGL3_Init("#version 330");
 
     initializeResolutions(monitor);
+    g_startup.window = sinceStartup();
 
-    Player player(glm::vec3(0.0f, 75.0f, 0.0f));
+    Player player(spawnPosition);
     g_player = &player;
 
     Renderer renderer;
-    if (!renderer.initialize()) {
+    if (!renderer.initialize(rendererAssets.get())) {
         std::cout << "Failed to initialize renderer" << std::endl;
         return -1;
     }
+    g_startup.renderer = sinceStartup();
+    if (!g_worldBuffer.initialize()) {
+        std::cout << "Failed to initialize world buffer" << std::endl;
+        return -1;
+    }
+    if (g_stagingRing.initialize(32u << 20)) {
+        g_meshStaging.store([](const void* data, size_t bytes, StagingSlice& out) {
+            return g_stagingRing.write(data, bytes, out);
+        });
+    }
 
     initPerlin(seed);
     ChunkManager chunkManager;
+    chunkManager.regions = &regionStore;
+    LodTerrain lodTerrain;
+    GpuTimer gpuDrawTimer;
+    g_profiler.setThreadName("main");
+    // VOXEL_TELEMETRY=host:port streams frame timings to backend/server.py
+    std::unique_ptr<TelemetryClient> telemetry;
+    if (const char* endpoint = std::getenv("VOXEL_TELEMETRY")) {
+        const char* source = std::getenv("VOXEL_TELEMETRY_SOURCE");
+        telemetry = std::make_unique<TelemetryClient>(endpoint, source ? source : "voxel");
+        std::cout << "Sending telemetry to " << endpoint << std::endl;
+    }
     player.setActiveWorld(&chunkManager);
     player.setRaycastOriginOffset(glm::vec3(0.5f, 0.5f, 0.5f));
 
-    int renderDistance = 8;
     updateChunks(chunkManager, player.position, renderDistance, renderer.getShaderProgram());
 
     float deltaTime = 0.0f;
-    float lastFrame = 0.0f;
-    float lastTime = glfwGetTime();
+    float lastFrame = glfwGetTime();
+    float lastTime = lastFrame;
     int frames = 0;
-    float frameTimeAccumulator = 0.0f;
+    float simulationLag = 0.0f;
+    float lastAutosave = lastFrame;
+    FramePacer pacer;
 
-    int lastCamChunkX = getChunkCoord(player.position.x);
-    int lastCamChunkZ = getChunkCoord(player.position.z);
+    GLuint shader = renderer.getShaderProgram();
+    GLint viewLoc = glGetUniformLocation(shader, "view");
+    GLint projectionLoc = glGetUniformLocation(shader, "projection");
+    glm::mat4 model = glm::mat4(1.0f);
+    glUseProgram(shader);
+    glUniformMatrix4fv(glGetUniformLocation(shader, "model"), 1, GL_FALSE, glm::value_ptr(model));
 
     std::cout << "Controls:" << std::endl;
     std::cout << "  WASD - Move" << std::endl;
@@ -477,17 +691,6 @@ int main(int argc, char* argv[]) {
     while (!glfwWindowShouldClose(window)) {
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
-
-        if (g_fpsLimit > 0) {
-            float targetFrameTime = 1.0f / g_fpsLimit;
-            frameTimeAccumulator += deltaTime;
-
-            if (frameTimeAccumulator < targetFrameTime) {
-                continue;
-            }
-            frameTimeAccumulator = 0.0f;
-        }
-
         lastFrame = currentFrame;
 
         frames++;
@@ -495,6 +698,9 @@ int main(int argc, char* argv[]) {
         if (currentTime - lastTime >= 1.0f) {
             std::cout << "FPS: " << frames
                       << " | Chunks: " << chunkManager.chunks.size()
+                      << " | Tris: " << g_worldMeshStats.triangles() << "/" << g_worldMeshStats.perFaceTriangles()
+                      << " | Drawn: " << g_cullStats.drawn << " Culled: " << g_cullStats.culled()
+                      << " | Uploads pending: " << g_meshUploads.pendingCount()
                       << " | Mode: " << (player.mode == MovementMode::FLY ? "FLY" : "NORMAL")
                       << " | Pos: (" << (int)player.position.x << ", " << (int)player.position.y << ", " << (int)player.position.z << ")"
                       << std::endl;
@@ -502,9 +708,19 @@ int main(int argc, char* argv[]) {
             lastTime += 1.0f;
         }
 
-        if (!g_showPauseMenu) {
-            player.processKeyboard(window, deltaTime, &chunkManager);
-            player.update(deltaTime, &chunkManager);
+        // Held until the ground around the spawn is meshed, so the player
+        // can't fall through chunks that aren't there yet
+        if (!g_showPauseMenu && g_startup.playable > 0.0f) {
+            PROFILE_SCOPE("player");
+            // After a long hitch run a few ticks, not seconds' worth
+            simulationLag += std::min(deltaTime, 0.25f);
+            while (simulationLag >= Player::TICK_SECONDS) {
+                player.beginTick();
+                player.processKeyboard(window, Player::TICK_SECONDS, &chunkManager);
+                player.update(Player::TICK_SECONDS, &chunkManager);
+                simulationLag -= Player::TICK_SECONDS;
+            }
+            player.interpolation = simulationLag / Player::TICK_SECONDS;
         }
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -514,72 +730,184 @@ int main(int argc, char* argv[]) {
         if (safeAspect <= 0.0f) {
             safeAspect = 16.0f / 9.0f;
         }
+        // Far enough for the corners of the outermost LOD ring
+        int viewChunks = std::max(renderDistance, g_lodDistance) + 1;
         glm::mat4 projection = glm::perspective(
             glm::radians(70.0f),
             safeAspect,
             0.1f,
-            500.0f
+            std::max(500.0f, viewChunks * 16.0f * 1.5f)
         );
 
-        glUseProgram(renderer.getShaderProgram());
-        glUniformMatrix4fv(
-            glGetUniformLocation(renderer.getShaderProgram(), "view"),
-            1, GL_FALSE, glm::value_ptr(view)
-        );
-        glUniformMatrix4fv(
-            glGetUniformLocation(renderer.getShaderProgram(), "projection"),
-            1, GL_FALSE, glm::value_ptr(projection)
-        );
+        glUseProgram(shader);
+        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
-        updateChunks(chunkManager, player.position, renderDistance, renderer.getShaderProgram());
+        if (g_remeshAll) {
+            for (const ChunkMap::Slot& slot : chunkManager.chunks) {
+                slot.chunk->markAllDirty();
+                chunkManager.requestRemesh(slot.chunk);
+            }
+            g_remeshAll = false;
+        }
 
-        while (true) {
-            CompletedMesh m;
-            if (!g_completedMeshes.try_pop(m)) break;
-            ManagedChunk* mc = chunkManager.getChunk(m.cx, m.cz);
-            if (!mc) continue;
-            mc->mesh.uploadToGPU(m.vertices);
-            mc->meshDirty = false;
-            mc->meshUploaded = true;
-            mc->inMeshQueue = false;
+        chunkManager.poolCap = (size_t)g_chunkPoolCap;
+        updateChunks(chunkManager, player.position, renderDistance, renderer.getShaderProgram());
+        g_pooledChunks = chunkManager.pool.size();
+        g_regionWrites = regionStore.queuedWrites();
+        lodTerrain.update(chunkManager, player.position, renderDistance, std::max(g_lodDistance, renderDistance));
+        g_lodTiles = lodTerrain.tileCount();
+        g_lodQuads = lodTerrain.quadCount();
+
+        // Edits also reach the disk while their chunks stay loaded
+        if (currentFrame - lastAutosave > 30.0f) {
+            chunkManager.saveAll();
+            lastAutosave = currentFrame;
         }
 
-        glBindTexture(GL_TEXTURE_2D, renderer.getAtlasTexture());
-        for (auto& pair : chunkManager.chunks) {
-            ManagedChunk* mc = pair.second;
-
-            glm::mat4 model = glm::mat4(1.0f);
-            glUniformMatrix4fv(
-                glGetUniformLocation(renderer.getShaderProgram(),
-                "model"),
-1, GL_FALSE, glm::value_ptr(model)
-                );
-            mc->mesh.draw();
+        Frustum frustum;
+        frustum.update(projection * view);
+
+        g_stagingRing.reclaim();
+        g_meshUploads.process(chunkManager, player.position, frustum, g_uploadBudget);
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, renderer.getAtlasTexture());
+        g_worldMeshStats = MeshStats();
+        g_cullStats = CullStats();
+        g_blockMemoryBytes = 0;
+
+        int camChunkX = getChunkCoord(player.position.x);
+        int camChunkZ = getChunkCoord(player.position.z);
+
+        // The stats loop below still frustum tests every section; when the walk
+        // succeeds only the sections it reached are drawn
+        static std::vector<VisibleSection> visibleSections;
+        visibleSections.clear();
+        const glm::vec3 eye = player.getCameraPosition() + glm::vec3(0.5f);
+        bool occlusion = g_occlusionCulling &&
+                         collectVisibleSections(chunkManager, eye, frustum, renderDistance, visibleSections);
+
+        {
+            PROFILE_SCOPE("draw");
+            g_worldBuffer.beginFrame();
+            for (const ChunkMap::Slot& slot : chunkManager.chunks) {
+                ManagedChunk* mc = slot.chunk;
+                g_blockMemoryBytes += mc->chunk.memoryBytes();
+
+                // The padding rings are only loaded for the generation stages edge chunks wait on
+                int cx = mc->chunk.chunkX;
+                int cz = mc->chunk.chunkZ;
+                bool outOfRange = std::abs(cx - camChunkX) > renderDistance || std::abs(cz - camChunkZ) > renderDistance;
+                glm::vec3 origin((float)(cx * (int)mc->chunk.width), 0.0f, (float)(cz * (int)mc->chunk.depth));
+
+                for (ChunkMesh& mesh : mc->meshes) {
+                    const MeshStats& stats = mesh.stats;
+                    g_worldMeshStats.faces += stats.faces;
+                    g_worldMeshStats.quads += stats.quads;
+
+                    if (mesh.quadCount() == 0) {
+                        g_cullStats.empty++;
+                        continue;
+                    }
+                    if (outOfRange) {
+                        g_cullStats.culledDistance++;
+                        continue;
+                    }
+
+                    glm::vec3 boxMin(origin.x - 0.5f, stats.minY - 0.5f, origin.z - 0.5f);
+                    glm::vec3 boxMax(origin.x + mc->chunk.width - 0.5f, stats.maxY - 0.5f, origin.z + mc->chunk.depth - 0.5f);
+                    if (!frustum.intersectsAABB(boxMin, boxMax)) {
+                        g_cullStats.culledFrustum++;
+                        continue;
+                    }
+
+                    g_cullStats.drawn++;
+                    if (!occlusion) mesh.draw(origin);
+                }
+            }
+            if (occlusion) {
+                for (const VisibleSection& v : visibleSections) {
+                    const Chunk& c = v.chunk->chunk;
+                    v.chunk->meshes[v.section].draw(glm::vec3((float)(c.chunkX * (int)c.width), 0.0f,
+                                                              (float)(c.chunkZ * (int)c.depth)));
+                }
+                g_cullStats.culledOcclusion = g_cullStats.drawn - (unsigned int)visibleSections.size();
+                g_cullStats.drawn = (unsigned int)visibleSections.size();
+            }
+            g_lodCullStats = CullStats();
+            lodTerrain.draw(frustum, g_lodCullStats);
+            gpuDrawTimer.begin();
+            g_worldBuffer.submit();
+            gpuDrawTimer.end();
         }
 
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
+        {
+            PROFILE_SCOPE("imgui");
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+
+            if (g_showPauseMenu) {
+                if (g_showSettings) {
+                    renderSettingsMenu(window);
+                } else {
+                    renderPauseMenu(window);
+                }
+            }
 
-        if (g_showPauseMenu) {
-            if (g_showSettings) {
-                renderSettingsMenu(window);
-            } else {
-                renderPauseMenu(window);
+            if (!g_showPauseMenu) {
+                player.renderHUD();
+            }
+            if (g_showProfiler) {
+                renderProfilerOverlay(chunkManager, gpuDrawTimer, telemetry.get());
             }
-        }
 
-        if (!g_showPauseMenu) {
-            player.renderHUD();
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         }
 
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        {
+            PROFILE_SCOPE("swap");
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        {
+            PROFILE_SCOPE("pace");
+            pacer.wait(g_fpsLimit);
+        }
+        if (g_startup.firstFrame == 0.0f) g_startup.firstFrame = sinceStartup();
+        if (g_startup.playable == 0.0f &&
+            neighbourhoodMeshed(chunkManager, (int)std::floor(player.position.x / 16.0f),
+                                (int)std::floor(player.position.z / 16.0f))) {
+            g_startup.playable = sinceStartup();
+            std::cout << "Startup: window " << (int)g_startup.window << " ms"
+                      << " | Renderer " << (int)g_startup.renderer << " ms (atlas from " << renderer.atlasSource
+                      << ", program " << (renderer.programFromCache ? "from cache" : "compiled") << ")"
+                      << " | First frame " << (int)g_startup.firstFrame << " ms"
+                      << " | Playable " << (int)g_startup.playable << " ms"
+                      << (g_startup.playable > STARTUP_TARGET_MS ? ", over the " : " of a ") << (int)STARTUP_TARGET_MS
+                      << " ms target" << std::endl;
+        }
+        g_profiler.endFrame();
+        if (telemetry) {
+            telemetry->record(g_profiler.lastFrameMillis(), g_profiler.lastStages());
+        }
     }
 
+    // No job may outlive what it points at: chunks, the manager, the region
+    // store, the staging ring and the static completion queues
+    chunkManager.cancelJobs();
+    shutdownJobSystem();
+    chunkManager.saveAll();
+    regionStore.flush();
+
+    lodTerrain.clear();
+    gpuDrawTimer.shutdown();
+    // Workers are joined above, so none is inside write() any more
+    g_meshStaging.store(nullptr);
+    g_stagingRing.shutdown();
+    g_worldBuffer.shutdown();
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -0,0 +1,88 @@
+#include "mesh_upload.h"
+#include "world_buffer.h"
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+
+void MeshUploadQueue::process(ChunkManager& manager, const glm::vec3& cameraPos, const Frustum& frustum,
+                              const UploadBudget& budget) {
+    PROFILE_SCOPE("mesh uploads");
+    auto start = std::chrono::steady_clock::now();
+
+    g_completedMeshes.popBatch(pending);
+
+    // Smaller keys first; out-of-frustum meshes sort after every visible one
+    const float outOfFrustum = 1e12f;
+    order.clear();
+    for (size_t i = 0; i < pending.size(); i++) {
+        const CompletedMesh& m = pending[i];
+        ManagedChunk* mc = manager.getChunk(m.cx, m.cz);
+        float key = 0.0f;
+        if (mc) {
+            float half = 0.5f * (float)mc->chunk.width;
+            glm::vec3 center((float)(m.cx * (int)mc->chunk.width) + half - 0.5f, cameraPos.y,
+                             (float)(m.cz * (int)mc->chunk.depth) + half - 0.5f);
+            float dx = center.x - cameraPos.x;
+            float dz = center.z - cameraPos.z;
+            key = dx * dx + dz * dz;
+
+            glm::vec3 boxMin(center.x - half, m.stats.minY - 0.5f, center.z - half);
+            glm::vec3 boxMax(center.x + half, m.stats.maxY - 0.5f, center.z + half);
+            if (!frustum.intersectsAABB(boxMin, boxMax)) key += outOfFrustum;
+        }
+        order.emplace_back(key, i);
+    }
+    std::sort(order.begin(), order.end());
+
+    const size_t maxBytes = (size_t)budget.maxKiBPerFrame * 1024;
+    stats = UploadStats();
+
+    std::vector<bool> done(pending.size(), false);
+    for (auto& entry : order) {
+        CompletedMesh& m = pending[entry.second];
+        ManagedChunk* mc = manager.getChunk(m.cx, m.cz);
+        if (mc && mc->id != m.chunkId) mc = nullptr;
+        if (!mc || m.generation != mc->generations[m.section]) {
+            // Unloaded, or the section changed after the job was queued
+            if (mc) {
+                mc->queuedSections &= ~(1u << m.section);
+                if (mc->dirtySections) manager.requestRemesh(mc);
+            }
+            g_stagingRing.release(m.staging);
+            done[entry.second] = true;
+            continue;
+        }
+
+        size_t bytes = (size_t)m.vertexCount * sizeof(PackedVertex);
+        if (stats.uploaded > 0) {
+            float elapsed = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (stats.bytes + bytes > maxBytes || elapsed > budget.maxMillisPerFrame) break;
+        }
+
+        ChunkMesh& mesh = mc->meshes[m.section];
+        if (m.staging.valid()) {
+            mesh.uploadFromStaging(m.staging, m.vertexCount);
+        } else {
+            mesh.uploadToGPU(m.vertices);
+        }
+        mesh.stats = m.stats;
+        mc->queuedSections &= ~(1u << m.section);
+        // Edited again while the job ran
+        if (mc->dirtySections) manager.requestRemesh(mc);
+
+        stats.uploaded++;
+        stats.bytes += bytes;
+        done[entry.second] = true;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (done[i]) continue;
+        if (kept != i) pending[kept] = std::move(pending[i]);
+        kept++;
+    }
+    pending.resize(kept);
+
+    stats.deferred = (unsigned int)pending.size();
+    stats.millis = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include "world.h"
+#include "frustum.h"
+
+struct UploadBudget {
+    int maxKiBPerFrame = 4096;
+    float maxMillisPerFrame = 2.0f;
+};
+
+struct UploadStats {
+    unsigned int uploaded = 0;  // last frame
+    unsigned int deferred = 0;  // left pending after last frame
+    size_t bytes = 0;           // uploaded last frame
+    float millis = 0.0f;        // spent uploading last frame
+};
+
+// Finished meshes wait here instead of all being uploaded the frame they
+// arrive. Each frame the pending list is ordered nearest first, in-frustum
+// before out-of-frustum, and uploaded until the byte or time budget is
+// spent; the rest is deferred. At least one mesh goes up per frame.
+class MeshUploadQueue {
+public:
+    void process(ChunkManager& manager, const glm::vec3& cameraPos, const Frustum& frustum,
+                 const UploadBudget& budget);
+
+    const UploadStats& getStats() const { return stats; }
+    size_t pendingCount() const { return pending.size(); }
+
+private:
+    std::vector<CompletedMesh> pending;
+    std::vector<std::pair<float, size_t>> order;
+    UploadStats stats;
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free queue for many producers and one consumer. Each cell
+// carries a sequence number telling whose turn it is: producers claim a slot
+// with one CAS on the tail, the consumer never touches shared counters
+// other than its own head. Capacity is rounded up to a power of two.
+template <class T>
+class MpscQueue {
+public:
+    explicit MpscQueue(size_t capacity) {
+        size_t n = 1;
+        while (n < capacity) n <<= 1;
+        cells = std::vector<Cell>(n);
+        mask = n - 1;
+        for (size_t i = 0; i < n; i++) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Any thread. Fails when the queue is full.
+    bool tryPush(T&& value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->seq.store(pos + 1, std::memory_order_release);
+
+        // head may be stale here, so clamp to what the ring can hold
+        size_t d = std::min(pos + 1 - head.load(std::memory_order_relaxed), mask + 1);
+        size_t peak = highWater.load(std::memory_order_relaxed);
+        while (d > peak && !highWater.compare_exchange_weak(peak, d, std::memory_order_relaxed)) {}
+        return true;
+    }
+
+    // Any thread. Waits for the consumer when the queue is full.
+    void push(T value) {
+        while (!tryPush(std::move(value))) std::this_thread::yield();
+    }
+
+    // Consumer thread only
+    bool tryPop(T& out) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        Cell& cell = cells[pos & mask];
+        if (cell.seq.load(std::memory_order_acquire) != pos + 1) return false;
+        out = std::move(cell.value);
+        cell.seq.store(pos + mask + 1, std::memory_order_release);
+        head.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Consumer thread only. Appends up to maxCount items to out, returns how many.
+    size_t popBatch(std::vector<T>& out, size_t maxCount = SIZE_MAX) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        size_t n = 0;
+        while (n < maxCount) {
+            Cell& cell = cells[pos & mask];
+            if (cell.seq.load(std::memory_order_acquire) != pos + 1) break;
+            out.push_back(std::move(cell.value));
+            cell.seq.store(pos + mask + 1, std::memory_order_release);
+            pos++;
+            n++;
+        }
+        head.store(pos, std::memory_order_relaxed);
+        return n;
+    }
+
+    size_t capacity() const { return mask + 1; }
+    // Approximate while producers are active
+    size_t depth() const {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_relaxed);
+        return t > h ? t - h : 0;
+    }
+    size_t highWaterMark() const { return highWater.load(std::memory_order_relaxed); }
+    void resetHighWaterMark() { highWater.store(depth(), std::memory_order_relaxed); }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq{0};
+        T value;
+    };
+
+    std::vector<Cell> cells;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> highWater{0};
+};
@@ -0,0 +1,324 @@
+#include "noise.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#if NOISE_LANES == 8
+#include <immintrin.h>
+#elif NOISE_LANES == 4
+#include <emmintrin.h>
+#endif
+
+int perm[512];
+
+void initPerlin(unsigned int seed) {
+    std::srand(seed);
+    std::vector<int> p(256);
+    for (int i = 0; i < 256; i++) p[i] = i;
+
+    for (int i = 255; i > 0; i--) {
+        int j = std::rand() % (i + 1);
+        std::swap(p[i], p[j]);
+    }
+
+    for (int i = 0; i < 512; i++) perm[i] = p[i & 255];
+}
+
+float fade(float t) {
+    return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+float lerp(float a, float b, float t) {
+    return a + t * (b - a);
+}
+
+float grad(int hash, float x, float y) {
+    int h = hash & 7;
+    float u = h < 4 ? x : y;
+    float v = h < 4 ? y : x;
+    return ((h & 1) ? -u : u) + ((h & 2) ? -2.0f*v : 2.0f*v);
+}
+
+float grad3(int hash, float x, float y, float z) {
+    int h = hash & 15;
+    float u = h < 8 ? x : y;
+    float v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
+    return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+
+float perlin(float x, float y) {
+    int X = (int)floor(x) & 255;
+    int Y = (int)floor(y) & 255;
+
+    x -= floor(x);
+    y -= floor(y);
+
+    float u = fade(x);
+    float v = fade(y);
+
+    int aa = perm[X + perm[Y]];
+    int ab = perm[X + perm[Y + 1]];
+    int ba = perm[X + 1 + perm[Y]];
+    int bb = perm[X + 1 + perm[Y + 1]];
+
+    float res = lerp(
+        lerp(grad(aa, x, y), grad(ba, x - 1, y), u),
+        lerp(grad(ab, x, y - 1), grad(bb, x - 1, y - 1), u),
+        v
+    );
+
+    return res;
+}
+
+float perlin3(float x, float y, float z) {
+    int X = (int)floor(x) & 255;
+    int Y = (int)floor(y) & 255;
+    int Z = (int)floor(z) & 255;
+
+    x -= floor(x);
+    y -= floor(y);
+    z -= floor(z);
+
+    float u = fade(x);
+    float v = fade(y);
+    float w = fade(z);
+
+    int A  = perm[X] + Y;
+    int AA = perm[A] + Z;
+    int AB = perm[A + 1] + Z;
+
+    int B  = perm[X + 1] + Y;
+    int BA = perm[B] + Z;
+    int BB = perm[B + 1] + Z;
+
+    float res =
+        lerp(
+            lerp(
+                lerp(grad3(perm[AA], x,     y,     z),
+                     grad3(perm[BA], x-1.0, y,     z), u),
+                lerp(grad3(perm[AB], x,     y-1.0, z),
+                     grad3(perm[BB], x-1.0, y-1.0, z), u),
+                v),
+            lerp(
+                lerp(grad3(perm[AA+1], x,     y,     z-1.0),
+                     grad3(perm[BA+1], x-1.0, y,     z-1.0), u),
+                lerp(grad3(perm[AB+1], x,     y-1.0, z-1.0),
+                     grad3(perm[BB+1], x-1.0, y-1.0, z-1.0), u),
+                v),
+            w);
+
+    return res;
+}
+
+#if NOISE_LANES > 1
+// The vector kernels repeat the scalar arithmetic operation for operation
+// (no fused multiply-add), which is what keeps them bit-exact. The only
+// change is floor, done with a truncating convert; inputs stay far below
+// 2^24, where that is exact.
+namespace {
+
+#if NOISE_LANES == 8
+using vf = __m256;
+using vi = __m256i;
+
+inline vf loadf(const float* p) { return _mm256_loadu_ps(p); }
+inline void storef(float* p, vf v) { _mm256_storeu_ps(p, v); }
+inline vf setf(float x) { return _mm256_set1_ps(x); }
+inline vi seti(int x) { return _mm256_set1_epi32(x); }
+inline vf add(vf a, vf b) { return _mm256_add_ps(a, b); }
+inline vf sub(vf a, vf b) { return _mm256_sub_ps(a, b); }
+inline vf mul(vf a, vf b) { return _mm256_mul_ps(a, b); }
+inline vf xorf(vf a, vi b) { return _mm256_xor_ps(a, _mm256_castsi256_ps(b)); }
+inline vi addi(vi a, vi b) { return _mm256_add_epi32(a, b); }
+inline vi andi(vi a, vi b) { return _mm256_and_si256(a, b); }
+inline vi ori(vi a, vi b) { return _mm256_or_si256(a, b); }
+inline vi eqi(vi a, vi b) { return _mm256_cmpeq_epi32(a, b); }
+inline vi lti(vi a, vi b) { return _mm256_cmpgt_epi32(b, a); }
+inline vf tof(vi a) { return _mm256_cvtepi32_ps(a); }
+// mask ? a : b, per lane
+inline vf select(vi mask, vf a, vf b) { return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(mask)); }
+inline vi floori(vf x) {
+    vi t = _mm256_cvttps_epi32(x);
+    vi over = _mm256_castps_si256(_mm256_cmp_ps(tof(t), x, _CMP_GT_OQ));
+    return addi(t, over); // -1 where truncation rounded up
+}
+inline vi lookup(vi index) { return _mm256_i32gather_epi32(perm, index, 4); }
+#else
+using vf = __m128;
+using vi = __m128i;
+
+inline vf loadf(const float* p) { return _mm_loadu_ps(p); }
+inline void storef(float* p, vf v) { _mm_storeu_ps(p, v); }
+inline vf setf(float x) { return _mm_set1_ps(x); }
+inline vi seti(int x) { return _mm_set1_epi32(x); }
+inline vf add(vf a, vf b) { return _mm_add_ps(a, b); }
+inline vf sub(vf a, vf b) { return _mm_sub_ps(a, b); }
+inline vf mul(vf a, vf b) { return _mm_mul_ps(a, b); }
+inline vf xorf(vf a, vi b) { return _mm_xor_ps(a, _mm_castsi128_ps(b)); }
+inline vi addi(vi a, vi b) { return _mm_add_epi32(a, b); }
+inline vi andi(vi a, vi b) { return _mm_and_si128(a, b); }
+inline vi ori(vi a, vi b) { return _mm_or_si128(a, b); }
+inline vi eqi(vi a, vi b) { return _mm_cmpeq_epi32(a, b); }
+inline vi lti(vi a, vi b) { return _mm_cmplt_epi32(a, b); }
+inline vf tof(vi a) { return _mm_cvtepi32_ps(a); }
+inline vf select(vi mask, vf a, vf b) {
+    vf m = _mm_castsi128_ps(mask);
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+inline vi floori(vf x) {
+    vi t = _mm_cvttps_epi32(x);
+    vi over = _mm_castps_si128(_mm_cmpgt_ps(tof(t), x));
+    return addi(t, over);
+}
+// SSE2 has no gather
+inline vi lookup(vi index) {
+    alignas(16) int32_t i[4];
+    _mm_store_si128((__m128i*)i, index);
+    return _mm_set_epi32(perm[i[3]], perm[i[2]], perm[i[1]], perm[i[0]]);
+}
+#endif
+
+inline vf fadev(vf t) {
+    return mul(mul(mul(t, t), t), add(mul(t, sub(mul(t, setf(6.0f)), setf(15.0f))), setf(10.0f)));
+}
+
+inline vf lerpv(vf a, vf b, vf t) {
+    return add(a, mul(t, sub(b, a)));
+}
+
+// Negates the lanes of v where h has the given bit set
+inline vf negateIf(vf v, vi h, int bit) {
+    vi set = eqi(andi(h, seti(bit)), seti(bit));
+    return xorf(v, andi(set, seti((int)0x80000000)));
+}
+
+inline vf gradv(vi hash, vf x, vf y) {
+    vi h = andi(hash, seti(7));
+    vi low = lti(h, seti(4));
+    vf u = select(low, x, y);
+    vf v = select(low, y, x);
+    return add(negateIf(u, h, 1), negateIf(mul(setf(2.0f), v), h, 2));
+}
+
+inline vf grad3v(vi hash, vf x, vf y, vf z) {
+    vi h = andi(hash, seti(15));
+    vf u = select(lti(h, seti(8)), x, y);
+    vi useX = ori(eqi(h, seti(12)), eqi(h, seti(14)));
+    vf v = select(lti(h, seti(4)), y, select(useX, x, z));
+    return add(negateIf(u, h, 1), negateIf(v, h, 2));
+}
+
+vf perlinv(vf x, vf y) {
+    vi xi = floori(x);
+    vi yi = floori(y);
+    x = sub(x, tof(xi));
+    y = sub(y, tof(yi));
+    vi X = andi(xi, seti(255));
+    vi Y = andi(yi, seti(255));
+    vi X1 = addi(X, seti(1));
+
+    vf u = fadev(x);
+    vf v = fadev(y);
+
+    vi pY = lookup(Y);
+    vi pY1 = lookup(addi(Y, seti(1)));
+    vi aa = lookup(addi(X, pY));
+    vi ab = lookup(addi(X, pY1));
+    vi ba = lookup(addi(X1, pY));
+    vi bb = lookup(addi(X1, pY1));
+
+    vf one = setf(1.0f);
+    vf x1 = sub(x, one);
+    vf y1 = sub(y, one);
+    return lerpv(lerpv(gradv(aa, x, y), gradv(ba, x1, y), u),
+                 lerpv(gradv(ab, x, y1), gradv(bb, x1, y1), u), v);
+}
+
+vf perlin3v(vf x, vf y, vf z) {
+    vi xi = floori(x);
+    vi yi = floori(y);
+    vi zi = floori(z);
+    x = sub(x, tof(xi));
+    y = sub(y, tof(yi));
+    z = sub(z, tof(zi));
+    vi X = andi(xi, seti(255));
+    vi Y = andi(yi, seti(255));
+    vi Z = andi(zi, seti(255));
+
+    vf u = fadev(x);
+    vf v = fadev(y);
+    vf w = fadev(z);
+
+    vi one = seti(1);
+    vi A = addi(lookup(X), Y);
+    vi AA = addi(lookup(A), Z);
+    vi AB = addi(lookup(addi(A, one)), Z);
+    vi B = addi(lookup(addi(X, one)), Y);
+    vi BA = addi(lookup(B), Z);
+    vi BB = addi(lookup(addi(B, one)), Z);
+
+    vf x1 = sub(x, setf(1.0f));
+    vf y1 = sub(y, setf(1.0f));
+    vf z1 = sub(z, setf(1.0f));
+    return lerpv(
+        lerpv(lerpv(grad3v(lookup(AA), x, y, z), grad3v(lookup(BA), x1, y, z), u),
+              lerpv(grad3v(lookup(AB), x, y1, z), grad3v(lookup(BB), x1, y1, z), u), v),
+        lerpv(lerpv(grad3v(lookup(addi(AA, one)), x, y, z1), grad3v(lookup(addi(BA, one)), x1, y, z1), u),
+              lerpv(grad3v(lookup(addi(AB, one)), x, y1, z1), grad3v(lookup(addi(BB, one)), x1, y1, z1), u), v),
+        w);
+}
+
+} // namespace
+
+void perlinBatch(const float* x, const float* y, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + NOISE_LANES <= n; i += NOISE_LANES) {
+        storef(out + i, perlinv(loadf(x + i), loadf(y + i)));
+    }
+    if (i == n) return;
+    // Tail through a padded copy; the padding lanes are computed and dropped
+    float tx[NOISE_LANES] = {}, ty[NOISE_LANES] = {}, to[NOISE_LANES];
+    std::copy(x + i, x + n, tx);
+    std::copy(y + i, y + n, ty);
+    storef(to, perlinv(loadf(tx), loadf(ty)));
+    std::copy(to, to + (n - i), out + i);
+}
+
+void perlin3Batch(const float* x, const float* y, const float* z, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + NOISE_LANES <= n; i += NOISE_LANES) {
+        storef(out + i, perlin3v(loadf(x + i), loadf(y + i), loadf(z + i)));
+    }
+    if (i == n) return;
+    float tx[NOISE_LANES] = {}, ty[NOISE_LANES] = {}, tz[NOISE_LANES] = {}, to[NOISE_LANES];
+    std::copy(x + i, x + n, tx);
+    std::copy(y + i, y + n, ty);
+    std::copy(z + i, z + n, tz);
+    storef(to, perlin3v(loadf(tx), loadf(ty), loadf(tz)));
+    std::copy(to, to + (n - i), out + i);
+}
+#else
+void perlinBatch(const float* x, const float* y, float* out, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = perlin(x[i], y[i]);
+}
+
+void perlin3Batch(const float* x, const float* y, const float* z, float* out, size_t n) {
+    for (size_t i = 0; i < n; i++) out[i] = perlin3(x[i], y[i], z[i]);
+}
+#endif
+
+void perlinColumns(int worldX0, int worldZ0, int w, int d, float scale, float offsetX, float offsetZ, float* out,
+                   int step) {
+    size_t count = (size_t)w * d;
+    std::vector<float> xs(count), zs(count);
+    for (int z = 0; z < d; z++) {
+        for (int x = 0; x < w; x++) {
+            xs[x + w * z] = (worldX0 + x * step) * scale + offsetX;
+            zs[x + w * z] = (worldZ0 + z * step) * scale + offsetZ;
+        }
+    }
+    perlinBatch(xs.data(), zs.data(), out, count);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+
+// Classic Perlin noise over a shared 256-entry permutation. The batch
+// versions run NOISE_LANES points per step (AVX2: 8, SSE2: 4, otherwise 1)
+// and return exactly what the scalar functions return for the same inputs,
+// so terrain doesn't depend on which path built it.
+#if defined(__AVX2__)
+#define NOISE_LANES 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NOISE_LANES 4
+#else
+#define NOISE_LANES 1
+#endif
+
+void initPerlin(unsigned int seed = 0);
+float perlin(float x, float y);
+float perlin3(float x, float y, float z);
+
+// out[i] = perlin(x[i], y[i])
+void perlinBatch(const float* x, const float* y, float* out, size_t n);
+// out[i] = perlin3(x[i], y[i], z[i])
+void perlin3Batch(const float* x, const float* y, const float* z, float* out, size_t n);
+
+// Samples a w x d grid of world columns starting at (worldX0, worldZ0), step
+// blocks apart:
+// out[x + w * z] = perlin((worldX0 + x * step) * scale + offsetX, (worldZ0 + z * step) * scale + offsetZ)
+void perlinColumns(int worldX0, int worldZ0, int w, int d, float scale, float offsetX, float offsetZ, float* out,
+                   int step = 1);
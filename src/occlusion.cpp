@@ -0,0 +1,84 @@
+#include "occlusion.h"
+#include "world.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+struct Step {
+    int cx, sy, cz;
+    ManagedChunk* chunk;
+    int from;     // face the walk entered through, -1 for the camera's section
+    uint8_t dirs; // directions travelled so far, one bit per face
+};
+
+// Neighbour offsets per face, cubeFaces order
+const int faceOffsets[6][3] = {{0,0,-1},{0,0,1},{-1,0,0},{1,0,0},{0,-1,0},{0,1,0}};
+
+} // namespace
+
+bool collectVisibleSections(ChunkManager& manager, const glm::vec3& camera, const Frustum& frustum,
+                            int renderDistance, std::vector<VisibleSection>& out) {
+    PROFILE_SCOPE("occlusion");
+    const int camChunkX = getChunkCoord(camera.x);
+    const int camChunkZ = getChunkCoord(camera.z);
+    ManagedChunk* start = manager.getChunk(camChunkX, camChunkZ);
+    if (!start) return false;
+
+    const int w = (int)start->chunk.width;
+    const int d = (int)start->chunk.depth;
+    const int sections = start->chunk.sectionCount();
+    const int side = 2 * renderDistance + 1;
+    // Cameras above or below the world start from its edge
+    int camSection = (int)std::floor(camera.y / SECTION_HEIGHT);
+    camSection = std::max(0, std::min(camSection, sections - 1));
+
+    static std::vector<uint8_t> visited;
+    static std::vector<Step> queue;
+    visited.assign((size_t)side * side * sections, 0);
+    queue.clear();
+    auto slot = [&](int cx, int sy, int cz) -> uint8_t& {
+        return visited[(size_t)(cx - camChunkX + renderDistance) +
+                       side * ((size_t)(cz - camChunkZ + renderDistance) + side * (size_t)sy)];
+    };
+
+    slot(camChunkX, camSection, camChunkZ) = 1;
+    queue.push_back({camChunkX, camSection, camChunkZ, start, -1, 0});
+    for (size_t head = 0; head < queue.size(); head++) {
+        const Step s = queue[head];
+        const ChunkMesh& mesh = s.chunk->meshes[s.sy];
+
+        if (mesh.quadCount() > 0) {
+            glm::vec3 boxMin((float)(s.cx * w) - 0.5f, mesh.stats.minY - 0.5f, (float)(s.cz * d) - 0.5f);
+            glm::vec3 boxMax(boxMin.x + w, mesh.stats.maxY - 0.5f, boxMin.z + d);
+            if (frustum.intersectsAABB(boxMin, boxMax)) out.push_back({s.chunk, s.sy});
+        }
+
+        for (int f = 0; f < 6; f++) {
+            // Never back towards the camera
+            if (s.dirs & (1 << (f ^ 1))) continue;
+            if (s.from >= 0 && !facesConnected(mesh.stats.visibility, s.from, f)) continue;
+
+            int nx = s.cx + faceOffsets[f][0];
+            int ny = s.sy + faceOffsets[f][1];
+            int nz = s.cz + faceOffsets[f][2];
+            if (ny < 0 || ny >= sections) continue;
+            if (std::abs(nx - camChunkX) > renderDistance || std::abs(nz - camChunkZ) > renderDistance) continue;
+            uint8_t& seen = slot(nx, ny, nz);
+            if (seen) continue;
+            seen = 1;
+
+            ManagedChunk* next = (nx == s.cx && nz == s.cz) ? s.chunk : manager.getChunk(nx, nz);
+            if (!next || !next->reached(ChunkState::Lit)) continue;
+
+            glm::vec3 boxMin((float)(nx * w) - 0.5f, (float)(ny * SECTION_HEIGHT) - 0.5f, (float)(nz * d) - 0.5f);
+            glm::vec3 boxMax(boxMin.x + w, boxMin.y + SECTION_HEIGHT, boxMin.z + d);
+            if (!frustum.intersectsAABB(boxMin, boxMax)) continue;
+
+            queue.push_back({nx, ny, nz, next, f ^ 1, (uint8_t)(s.dirs | (1 << f))});
+        }
+    }
+    return true;
+}
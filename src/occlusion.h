@@ -0,0 +1,26 @@
+#pragma once
+#include "frustum.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+struct ChunkManager;
+struct ManagedChunk;
+
+struct VisibleSection {
+    ManagedChunk* chunk;
+    int section;
+};
+
+// Walks the section visibility graphs outwards from the camera's section,
+// the way Minecraft does: the walk only leaves a section through a face that
+// air joins to the face it came in by, never heads back towards the camera
+// and skips sections outside the frustum. Appends the reached sections that
+// have geometry and pass the same frustum test as the plain draw loop.
+// Sections that haven't been meshed yet count as open. Returns false, with
+// nothing appended, when the camera's chunk isn't loaded.
+//
+// camera is the eye in block space, where block (x, y, z) fills
+// [x, x + 1) on every axis, like Player::position. Render space, what
+// getCameraPosition() returns, is half a block lower on every axis.
+bool collectVisibleSections(ChunkManager& manager, const glm::vec3& camera, const Frustum& frustum,
+                            int renderDistance, std::vector<VisibleSection>& out);
@@ -5,6 +5,7 @@
 
 Player::Player(glm::vec3 startPos)
     : position(startPos),
+      previousPosition(startPos),
       velocity(0.0f),
       front(glm::vec3(0.0f, 0.0f, -1.0f)),
       up(glm::vec3(0.0f, 1.0f, 0.0f)),
@@ -149,88 +150,24 @@ const char* Player::blockName(BlockType t) {
 
 bool Player::raycastBlock(float maxDist, glm::ivec3& outBlock, glm::ivec3& outNormal) const {
     if (!worldRef) return false;
-    glm::vec3 rayOrigin = getCameraPosition() + raycastOriginOffset;
-    glm::vec3 rayDir = glm::normalize(front);
-
-    glm::ivec3 mapPos = glm::ivec3(glm::floor(rayOrigin));
-    glm::vec3 deltaDist = glm::abs(glm::vec3(
-        1.0f / (rayDir.x == 0.0f ? 1e-6f : rayDir.x),
-        1.0f / (rayDir.y == 0.0f ? 1e-6f : rayDir.y),
-        1.0f / (rayDir.z == 0.0f ? 1e-6f : rayDir.z)));
-
-    glm::ivec3 step(
-        rayDir.x < 0 ? -1 : 1,
-        rayDir.y < 0 ? -1 : 1,
-        rayDir.z < 0 ? -1 : 1
-    );
-
-    glm::vec3 sideDist;
-    sideDist.x = ((rayDir.x < 0 ? (rayOrigin.x - (float)mapPos.x) : ((float)mapPos.x + 1.0f - rayOrigin.x))) * deltaDist.x;
-    sideDist.y = ((rayDir.y < 0 ? (rayOrigin.y - (float)mapPos.y) : ((float)mapPos.y + 1.0f - rayOrigin.y))) * deltaDist.y;
-    sideDist.z = ((rayDir.z < 0 ? (rayOrigin.z - (float)mapPos.z) : ((float)mapPos.z + 1.0f - rayOrigin.z))) * deltaDist.z;
-
-    glm::ivec3 hitNormal(0);
-    float dist = 0.0f;
-    const float maxDistEps = maxDist + 1.0f;
-
-    while (dist <= maxDistEps) {
-        int cx = getChunkCoord((float)mapPos.x);
-        int cz = getChunkCoord((float)mapPos.z);
-        ManagedChunk* mc = worldRef->getChunk(cx, cz);
-        if (mc) {
-            int localX = mapPos.x - cx * (int)mc->chunk.width;
-            int localZ = mapPos.z - cz * (int)mc->chunk.depth;
-            if (localX >= 0 && localX < (int)mc->chunk.width &&
-                localZ >= 0 && localZ < (int)mc->chunk.depth &&
-                mapPos.y >= 0 && mapPos.y < (int)mc->chunk.height) {
-                BlockType bt = mc->chunk.getBlock(localX, mapPos.y, localZ).type;
-                if (bt != AIR) {
-                    outBlock = mapPos;
-                    outNormal = hitNormal;
-                    return true;
-                }
-            }
-        }
-
-        if (sideDist.x < sideDist.y) {
-            if (sideDist.x < sideDist.z) {
-                mapPos.x += step.x;
-                dist = sideDist.x;
-                sideDist.x += deltaDist.x;
-                hitNormal = glm::ivec3(-step.x, 0, 0);
-            } else {
-                mapPos.z += step.z;
-                dist = sideDist.z;
-                sideDist.z += deltaDist.z;
-                hitNormal = glm::ivec3(0, 0, -step.z);
-            }
-        } else {
-            if (sideDist.y < sideDist.z) {
-                mapPos.y += step.y;
-                dist = sideDist.y;
-                sideDist.y += deltaDist.y;
-                hitNormal = glm::ivec3(0, -step.y, 0);
-            } else {
-                mapPos.z += step.z;
-                dist = sideDist.z;
-                sideDist.z += deltaDist.z;
-                hitNormal = glm::ivec3(0, 0, -step.z);
-            }
-        }
-    }
-    return false;
+    // Cells entered up to a block past maxDist count, as they always have
+    WorldView::RayHit hit;
+    if (!WorldView(*worldRef).raycast(getCameraPosition() + raycastOriginOffset, glm::normalize(front),
+                                      maxDist + 1.0f, hit))
+        return false;
+    outBlock = hit.block;
+    outNormal = hit.normal;
+    return true;
 }
 
-void Player::rebuildChunkMesh(int worldX, int worldZ) {
+void Player::rebuildChunkMesh(int worldX, int y, int worldZ) {
     if (!worldRef) return;
     int cx = getChunkCoord((float)worldX);
     int cz = getChunkCoord((float)worldZ);
     ManagedChunk* mc = worldRef->getChunk(cx, cz);
-    if (mc) {
-        mc->meshDirty = true;
-        mc->meshUploaded = false;
-        mc->inMeshQueue = false;
-    }
+    if (!mc) return;
+    mc->urgentSections |= mc->markBlockDirty(y);
+    worldRef->requestRemesh(mc);
 }
 
 void Player::rebuildNeighborsIfEdge(int worldX, int y, int worldZ) {
@@ -241,11 +178,11 @@ void Player::rebuildNeighborsIfEdge(int worldX, int y, int worldZ) {
     if (!mc) return;
     int localX = worldX - cx * (int)mc->chunk.width;
     int localZ = worldZ - cz * (int)mc->chunk.depth;
-    rebuildChunkMesh(worldX, worldZ);
-    if (localX == 0) rebuildChunkMesh(worldX - 1, worldZ);
-    if (localX == (int)mc->chunk.width - 1) rebuildChunkMesh(worldX + 1, worldZ);
-    if (localZ == 0) rebuildChunkMesh(worldX, worldZ - 1);
-    if (localZ == (int)mc->chunk.depth - 1) rebuildChunkMesh(worldX, worldZ + 1);
+    rebuildChunkMesh(worldX, y, worldZ);
+    if (localX == 0) rebuildChunkMesh(worldX - 1, y, worldZ);
+    if (localX == (int)mc->chunk.width - 1) rebuildChunkMesh(worldX + 1, y, worldZ);
+    if (localZ == 0) rebuildChunkMesh(worldX, y, worldZ - 1);
+    if (localZ == (int)mc->chunk.depth - 1) rebuildChunkMesh(worldX, y, worldZ + 1);
 }
 
 void Player::handleMouseButton(int button, int action, int mods) {
@@ -323,77 +260,36 @@ glm::mat4 Player::getViewMatrix() const {
 }
 
 glm::vec3 Player::getCameraPosition() const {
-    return position + glm::vec3(-0.5f, eyeHeight - 0.5f, -0.5f);
+    return glm::mix(previousPosition, position, interpolation) + glm::vec3(-0.5f, eyeHeight - 0.5f, -0.5f);
 }
 
 glm::vec3 Player::resolveCollision(glm::vec3 desiredPos, ChunkManager* world) {
     const float epsilon = 0.001f;
     glm::vec3 result = desiredPos;
+    WorldView view(*world);
     
     glm::vec3 testPos = position;
     testPos.x = desiredPos.x;
-    if (checkCollision(testPos, world)) {
+    if (checkCollision(testPos, view)) {
         result.x = position.x;
     }
     
     testPos = position;
     testPos.z = desiredPos.z;
-    if (checkCollision(testPos, world)) {
+    if (checkCollision(testPos, view)) {
         result.z = position.z;
     }
     
     testPos = position;
     testPos.y = desiredPos.y;
-    if (checkCollision(testPos, world)) {
+    if (checkCollision(testPos, view)) {
         result.y = position.y;
     }
     
     return result;
 }
 
-bool Player::checkCollision(glm::vec3 newPos, ChunkManager* world) {
+bool Player::checkCollision(glm::vec3 newPos, WorldView& view) {
     AABB playerBox(newPos, width, height, depth);
-    
-    int minX = (int)floor(playerBox.min.x);
-    int maxX = (int)ceil(playerBox.max.x);
-    int minY = (int)floor(playerBox.min.y);
-    int maxY = (int)ceil(playerBox.max.y);
-    int minZ = (int)floor(playerBox.min.z);
-    int maxZ = (int)ceil(playerBox.max.z);
-    
-    for (int x = minX; x <= maxX; x++) {
-        for (int y = minY; y <= maxY; y++) {
-            for (int z = minZ; z <= maxZ; z++) {
-                int cx = getChunkCoord((float)x);
-                int cz = getChunkCoord((float)z);
-                
-                ManagedChunk* chunk = world->getChunk(cx, cz);
-                if (!chunk) continue;
-                
-                int localX = x - cx * chunk->chunk.width;
-                int localZ = z - cz * chunk->chunk.depth;
-                
-                if (localX < 0 || localX >= (int)chunk->chunk.width ||
-                    localZ < 0 || localZ >= (int)chunk->chunk.depth ||
-                    y < 0 || y >= (int)chunk->chunk.height) {
-                    continue;
-                }
-                
-                BlockType blockType = chunk->chunk.getBlock(localX, y, localZ).type;
-                
-                if (isBlockSolid(blockType)) {
-                    AABB blockBox(glm::vec3(x + 0.5f, y, z + 0.5f), 1.0f, 1.0f, 1.0f);
-                    if (playerBox.intersects(blockBox)) {
-                        return true;
-                    }
-                }
-            }
-        }
-    }
-    
-    return false;
+    return view.anySolid(playerBox.min, playerBox.max);
 }
-
-bool Player::isBlockSolid(BlockType type) {
-    return type != AIR;
-}
\ No newline at end of file
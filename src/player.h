@@ -4,6 +4,7 @@
 #include <glm/glm.hpp>
 #include <vector>
 #include "world.h"
+#include "world_view.h"
 
 enum class MovementMode {
     FLY,
@@ -28,7 +29,15 @@ struct AABB {
 
 class Player {
 public:
+    // Movement and collisions run in fixed ticks: per tick, beginTick,
+    // processKeyboard and update with TICK_SECONDS. The camera is drawn
+    // between the previous tick's position and the current one, by
+    // interpolation, so motion is smooth at any frame rate.
+    static constexpr float TICK_SECONDS = 1.0f / 60.0f;
+
     glm::vec3 position;
+    glm::vec3 previousPosition;
+    float interpolation = 1.0f;
     glm::vec3 velocity;
     glm::vec3 front;
     glm::vec3 up;
@@ -60,6 +69,7 @@ public:
     void processMouseMovement(float xoffset, float yoffset, float sensitivity = 0.1f);
     void processKeyboard(GLFWwindow* window, float deltaTime, ChunkManager* world);
     void update(float deltaTime, ChunkManager* world);
+    void beginTick() { previousPosition = position; }
     
     glm::mat4 getViewMatrix() const;
     glm::vec3 getCameraPosition() const;
@@ -75,12 +85,11 @@ public:
 
 private:
     void updateVectors();
-    bool checkCollision(glm::vec3 newPos, ChunkManager* world);
+    bool checkCollision(glm::vec3 newPos, WorldView& view);
     glm::vec3 resolveCollision(glm::vec3 desiredPos, ChunkManager* world);
-    bool isBlockSolid(BlockType type);
 
     bool raycastBlock(float maxDist, glm::ivec3& outBlock, glm::ivec3& outNormal) const;
-    void rebuildChunkMesh(int worldX, int worldZ);
+    void rebuildChunkMesh(int worldX, int y, int worldZ);
     void rebuildNeighborsIfEdge(int worldX, int y, int worldZ);
 
     int selectedBlock = 1;
@@ -0,0 +1,138 @@
+#include "profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+Profiler g_profiler;
+
+uint64_t Profiler::now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler::ThreadTrace& Profiler::thread() {
+    thread_local ThreadTrace* t = nullptr;
+    if (!t) {
+        std::lock_guard<std::mutex> lock(mtx);
+        threads.push_back(std::make_unique<ThreadTrace>());
+        t = threads.back().get();
+        t->id = (uint32_t)threads.size();
+        t->name = "thread " + std::to_string(t->id);
+    }
+    return *t;
+}
+
+void Profiler::setThreadName(const std::string& name) {
+    ThreadTrace& t = thread();
+    std::lock_guard<std::mutex> lock(mtx);
+    t.name = name;
+}
+
+void Profiler::endFrame() {
+    uint64_t end = now();
+    if (!mainThread) mainThread = &thread();
+
+    float frame = lastFrameEnd ? (float)((end - lastFrameEnd) / 1e6) : 0.0f;
+    lastFrameEnd = end;
+    frameMillis[frameCursor] = frame;
+    frameCursor = (frameCursor + 1) % FRAME_HISTORY;
+
+    // The main thread's own ring; no other thread writes it
+    uint64_t head = mainThread->head.load(std::memory_order_relaxed);
+    uint64_t first = mainThread->frameRead;
+    if (head - first > EVENTS_PER_THREAD) first = head - EVENTS_PER_THREAD;
+    mainThread->frameRead = head;
+
+    stages.clear();
+    for (uint64_t i = first; i < head; i++) {
+        const ProfileEvent& e = mainThread->events[i % EVENTS_PER_THREAD];
+        if (e.depth != 0) continue;
+        float ms = (float)((e.endNs - e.startNs) / 1e6);
+        bool found = false;
+        for (auto& stage : stages) {
+            if (stage.first == e.name) {
+                stage.second += ms;
+                found = true;
+                break;
+            }
+        }
+        if (!found) stages.emplace_back(e.name, ms);
+    }
+}
+
+static void writeJsonString(FILE* f, const char* s) {
+    std::fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') std::fputc('\\', f);
+        std::fputc(*s, f);
+    }
+    std::fputc('"', f);
+}
+
+bool Profiler::exportChromeTrace(const std::string& path) {
+    FILE* f = std::fopen(path.c_str(), "w");
+    if (!f) return false;
+
+    std::vector<std::pair<uint32_t, std::string>> names;
+    std::vector<ThreadTrace*> traces;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto& t : threads) {
+            traces.push_back(t.get());
+            names.emplace_back(t->id, t->name);
+        }
+    }
+
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+    bool firstEvent = true;
+    for (auto& n : names) {
+        std::fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                     firstEvent ? "" : ",\n", n.first);
+        writeJsonString(f, n.second.c_str());
+        std::fputs("}}", f);
+        firstEvent = false;
+    }
+
+    std::vector<ProfileEvent> copy;
+    for (ThreadTrace* t : traces) {
+        // Owners keep writing while this reads; whatever they may have
+        // overwritten during the copy is dropped afterwards
+        uint64_t head = t->head.load(std::memory_order_acquire);
+        uint64_t first = head > EVENTS_PER_THREAD ? head - EVENTS_PER_THREAD : 0;
+        copy.clear();
+        for (uint64_t i = first; i < head; i++) copy.push_back(t->events[i % EVENTS_PER_THREAD]);
+        uint64_t after = t->head.load(std::memory_order_acquire);
+        uint64_t valid = after >= EVENTS_PER_THREAD ? after - EVENTS_PER_THREAD + 1 : 0;
+
+        for (uint64_t i = std::max(first, valid); i < head; i++) {
+            const ProfileEvent& e = copy[i - first];
+            std::fprintf(f, "%s{\"name\":", firstEvent ? "" : ",\n");
+            writeJsonString(f, e.name);
+            std::fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", t->id,
+                         e.startNs / 1e3, (e.endNs - e.startNs) / 1e3);
+            firstEvent = false;
+        }
+    }
+    std::fputs("\n]}\n", f);
+    return std::fclose(f) == 0;
+}
+
+ProfileScope::ProfileScope(const char* name) : trace(nullptr), name(name), start(0) {
+    if (!g_profiler.enabled.load(std::memory_order_relaxed)) return;
+    trace = &g_profiler.thread();
+    trace->depth++;
+    start = Profiler::now();
+}
+
+ProfileScope::~ProfileScope() {
+    if (!trace) return;
+    uint64_t end = Profiler::now();
+    trace->depth--;
+    uint64_t head = trace->head.load(std::memory_order_relaxed);
+    ProfileEvent& e = trace->events[head % Profiler::EVENTS_PER_THREAD];
+    e.name = name;
+    e.startNs = start;
+    e.endNs = end;
+    e.depth = trace->depth;
+    trace->head.store(head + 1, std::memory_order_release);
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Scoped CPU timers. Every thread records into its own ring of the last
+// EVENTS_PER_THREAD scopes, so a scope costs two clock reads and a store
+// even on mesh workers; nothing is shared until the overlay or an export
+// reads the rings. Names must be string literals (or otherwise outlive the
+// program), only the pointer is stored.
+//
+//   { PROFILE_SCOPE("updateChunks"); ... }
+struct ProfileEvent {
+    const char* name = nullptr;
+    uint64_t startNs = 0;
+    uint64_t endNs = 0;
+    uint32_t depth = 0; // scopes open around it on its thread
+};
+
+class Profiler {
+public:
+    static constexpr size_t EVENTS_PER_THREAD = 16384;
+    static constexpr int FRAME_HISTORY = 240;
+
+    // Nanoseconds on a steady clock; the same origin for every thread
+    static uint64_t now();
+
+    // Names the calling thread in exports
+    void setThreadName(const std::string& name);
+
+    // Main thread, once per frame. Sums the outermost scopes the main thread
+    // closed since the previous call into the stage breakdown.
+    void endFrame();
+
+    // Main thread only
+    const std::vector<std::pair<const char*, float>>& lastStages() const { return stages; }
+    const float* frameHistory() const { return frameMillis; }
+    int frameHistoryOffset() const { return frameCursor; } // oldest entry
+    float lastFrameMillis() const { return frameMillis[(frameCursor + FRAME_HISTORY - 1) % FRAME_HISTORY]; }
+
+    // Writes the events still in the rings as Chrome trace JSON (chrome://tracing,
+    // Perfetto). False if the file can't be written.
+    bool exportChromeTrace(const std::string& path);
+
+    std::atomic<bool> enabled{true};
+
+private:
+    friend class ProfileScope;
+
+    struct ThreadTrace {
+        uint32_t id = 0;
+        std::string name;
+        std::unique_ptr<ProfileEvent[]> events{new ProfileEvent[EVENTS_PER_THREAD]};
+        std::atomic<uint64_t> head{0}; // events ever written; only the owner writes
+        uint32_t depth = 0;            // owner only
+        uint64_t frameRead = 0;        // main thread: first event of the current frame
+    };
+
+    ThreadTrace& thread();
+
+    std::mutex mtx; // guards threads
+    std::vector<std::unique_ptr<ThreadTrace>> threads;
+
+    ThreadTrace* mainThread = nullptr;
+    uint64_t lastFrameEnd = 0;
+    std::vector<std::pair<const char*, float>> stages;
+    float frameMillis[FRAME_HISTORY] = {};
+    int frameCursor = 0;
+};
+
+extern Profiler g_profiler;
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    Profiler::ThreadTrace* trace;
+    const char* name;
+    uint64_t start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope_, __LINE__)(name)
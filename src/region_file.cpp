@@ -0,0 +1,529 @@
+#include "region_file.h"
+#include "chunk_map.h"
+#include "lz4_block.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr uint32_t REGION_MAGIC = 0x47525856; // "VXRG"
+constexpr uint32_t REGION_VERSION = 1;
+constexpr size_t TABLE_OFFSET = 16;
+// Files grow by at least this many sectors, so appends rarely remap
+constexpr uint32_t MIN_GROWTH_SECTORS = 64;
+// Records hold their uncompressed size up front
+constexpr size_t RECORD_HEADER = 4;
+constexpr uint32_t MAX_RAW_BYTES = 1u << 20;
+
+constexpr uint8_t CHUNK_FORMAT = 1;
+constexpr uint8_t FLAG_STRUCTURES = 1;
+constexpr uint8_t MESH_FORMAT = 2;
+
+template <class T>
+void put(std::vector<uint8_t>& out, T value) {
+    size_t at = out.size();
+    out.resize(at + sizeof(T));
+    std::memcpy(out.data() + at, &value, sizeof(T));
+}
+
+template <class T>
+bool get(const uint8_t*& p, const uint8_t* end, T& value) {
+    if ((size_t)(end - p) < sizeof(T)) return false;
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+
+void putBytes(std::vector<uint8_t>& out, const std::vector<uint8_t>& bytes) {
+    put<uint16_t>(out, (uint16_t)bytes.size());
+    out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+bool getBytes(const uint8_t*& p, const uint8_t* end, std::vector<uint8_t>& bytes, size_t expected) {
+    uint16_t n;
+    if (!get(p, end, n) || n != expected || (size_t)(end - p) < n) return false;
+    bytes.assign(p, p + n);
+    p += n;
+    return true;
+}
+
+void serializeChunk(const Chunk& chunk, bool structuresDone, std::vector<uint8_t>& out) {
+    out.clear();
+    put<uint8_t>(out, CHUNK_FORMAT);
+    put<uint8_t>(out, structuresDone ? FLAG_STRUCTURES : 0);
+    put<uint16_t>(out, (uint16_t)chunk.width);
+    put<uint16_t>(out, (uint16_t)chunk.depth);
+    put<uint16_t>(out, (uint16_t)chunk.height);
+    for (const PalettedSection& s : chunk.sections) s.serialize(out);
+    putBytes(out, chunk.heightmap);
+    putBytes(out, chunk.biomes);
+}
+
+// Fills chunk only if the whole record is valid for its dimensions
+bool deserializeChunk(const std::vector<uint8_t>& raw, Chunk& chunk, bool& structuresDone) {
+    const uint8_t* p = raw.data();
+    const uint8_t* end = p + raw.size();
+    uint8_t format, flags;
+    uint16_t w, d, h;
+    if (!get(p, end, format) || format != CHUNK_FORMAT || !get(p, end, flags)) return false;
+    if (!get(p, end, w) || !get(p, end, d) || !get(p, end, h)) return false;
+    if (w != chunk.width || d != chunk.depth || h != chunk.height) return false;
+
+    std::vector<PalettedSection> sections(chunk.sections.size());
+    for (PalettedSection& s : sections) {
+        if (!s.deserialize(p, end, (size_t)w * d * SECTION_HEIGHT)) return false;
+    }
+    std::vector<uint8_t> heightmap, biomes;
+    if (!getBytes(p, end, heightmap, (size_t)w * d) || !getBytes(p, end, biomes, (size_t)w * d)) return false;
+    if (p != end) return false;
+
+    chunk.sections = std::move(sections);
+    chunk.heightmap = std::move(heightmap);
+    chunk.biomes = std::move(biomes);
+    structuresDone = (flags & FLAG_STRUCTURES) != 0;
+    return true;
+}
+
+void serializeMesh(uint64_t key, const std::vector<PackedVertex>& vertices, const MeshStats& stats,
+                   std::vector<uint8_t>& out) {
+    out.clear();
+    put<uint8_t>(out, MESH_FORMAT);
+    put<uint64_t>(out, key);
+    put<uint32_t>(out, stats.faces);
+    put<uint32_t>(out, stats.quads);
+    put<uint32_t>(out, stats.minY);
+    put<uint32_t>(out, stats.maxY);
+    put<uint16_t>(out, stats.visibility);
+    put<uint32_t>(out, (uint32_t)vertices.size());
+    size_t at = out.size();
+    out.resize(at + vertices.size() * sizeof(PackedVertex));
+    if (!vertices.empty()) std::memcpy(out.data() + at, vertices.data(), vertices.size() * sizeof(PackedVertex));
+}
+
+// Fills vertices and stats only if the record is valid and was stored under key
+bool deserializeMesh(const std::vector<uint8_t>& raw, uint64_t key, std::vector<PackedVertex>& vertices,
+                     MeshStats& stats) {
+    const uint8_t* p = raw.data();
+    const uint8_t* end = p + raw.size();
+    uint8_t format;
+    uint64_t storedKey;
+    MeshStats s;
+    uint32_t count;
+    if (!get(p, end, format) || format != MESH_FORMAT) return false;
+    if (!get(p, end, storedKey) || storedKey != key) return false;
+    if (!get(p, end, s.faces) || !get(p, end, s.quads) || !get(p, end, s.minY) || !get(p, end, s.maxY)) return false;
+    if (!get(p, end, s.visibility)) return false;
+    if (!get(p, end, count) || (size_t)(end - p) != (size_t)count * sizeof(PackedVertex)) return false;
+
+    vertices.resize(count);
+    if (count) std::memcpy(vertices.data(), p, (size_t)count * sizeof(PackedVertex));
+    stats = s;
+    return true;
+}
+
+} // namespace
+
+std::unique_ptr<RegionFile> RegionFile::open(const std::string& path, bool create, int entries) {
+    std::unique_ptr<RegionFile> region(new RegionFile());
+    region->headerSectors = (uint32_t)((TABLE_OFFSET + (size_t)entries * sizeof(Entry) + SECTOR_BYTES - 1) / SECTOR_BYTES);
+    region->table.assign(entries, Entry());
+    bool created = false;
+#ifdef _WIN32
+    HANDLE h = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                           create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return nullptr;
+    created = GetLastError() != ERROR_ALREADY_EXISTS && create;
+    region->file = h;
+#else
+    int fd = ::open(path.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+    if (fd < 0) return nullptr;
+    region->fd = fd;
+    struct stat st;
+    if (fstat(fd, &st) != 0) return nullptr;
+    created = st.st_size == 0;
+#endif
+    if (!region->load(created)) {
+        std::cout << "Unreadable region file " << path << std::endl;
+        return nullptr;
+    }
+    return region;
+}
+
+RegionFile::~RegionFile() {
+    unmap();
+#ifdef _WIN32
+    if (file) CloseHandle((HANDLE)file);
+#else
+    if (fd >= 0) ::close(fd);
+#endif
+}
+
+bool RegionFile::load(bool created) {
+    size_t fileBytes = (size_t)(headerSectors + MIN_GROWTH_SECTORS) * SECTOR_BYTES;
+
+    if (created) {
+        std::vector<uint8_t> header(fileBytes, 0);
+        uint32_t prefix[2] = { REGION_MAGIC, REGION_VERSION };
+        std::memcpy(header.data(), prefix, sizeof(prefix));
+        if (!writeAt(0, header.data(), header.size())) return false;
+    } else {
+#ifdef _WIN32
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx((HANDLE)file, &size)) return false;
+        fileBytes = (size_t)size.QuadPart;
+#else
+        struct stat st;
+        if (fstat(fd, &st) != 0) return false;
+        fileBytes = (size_t)st.st_size;
+#endif
+        if (fileBytes < (size_t)headerSectors * SECTOR_BYTES) return false;
+    }
+    if (!map(fileBytes)) return false;
+
+    uint32_t prefix[2];
+    std::memcpy(prefix, mapped, sizeof(prefix));
+    if (prefix[0] != REGION_MAGIC || prefix[1] != REGION_VERSION) return false;
+
+    // Records that don't fit the file are treated as missing
+    uint32_t sectors = (uint32_t)(fileBytes / SECTOR_BYTES);
+    usedSectors.assign(sectors, false);
+    std::fill(usedSectors.begin(), usedSectors.begin() + headerSectors, true);
+    std::memcpy(table.data(), mapped + TABLE_OFFSET, table.size() * sizeof(Entry));
+    for (Entry& e : table) {
+        if (e.sector == 0) continue;
+        uint32_t count = (uint32_t)((e.bytes + SECTOR_BYTES - 1) / SECTOR_BYTES);
+        if (e.sector < headerSectors || e.bytes < RECORD_HEADER || e.sector + count > sectors) {
+            e = Entry();
+            continue;
+        }
+        for (uint32_t s = 0; s < count; s++) usedSectors[e.sector + s] = true;
+    }
+    return true;
+}
+
+bool RegionFile::map(size_t bytes) {
+#ifdef _WIN32
+    HANDLE m = CreateFileMappingA((HANDLE)file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m) return false;
+    void* view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(m);
+        return false;
+    }
+    mapping = m;
+    mapped = (const uint8_t*)view;
+#else
+    void* view = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED) return false;
+    mapped = (const uint8_t*)view;
+#endif
+    mappedBytes = bytes;
+    return true;
+}
+
+void RegionFile::unmap() {
+    if (!mapped) return;
+#ifdef _WIN32
+    UnmapViewOfFile(mapped);
+    CloseHandle((HANDLE)mapping);
+    mapping = nullptr;
+#else
+    munmap((void*)mapped, mappedBytes);
+#endif
+    mapped = nullptr;
+    mappedBytes = 0;
+}
+
+bool RegionFile::writeAt(size_t offset, const void* data, size_t size) {
+#ifdef _WIN32
+    OVERLAPPED at = {};
+    at.Offset = (DWORD)(offset & 0xFFFFFFFFu);
+    at.OffsetHigh = (DWORD)((uint64_t)offset >> 32);
+    DWORD written = 0;
+    return WriteFile((HANDLE)file, data, (DWORD)size, &written, &at) && written == size;
+#else
+    const uint8_t* p = (const uint8_t*)data;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, p, size, (off_t)offset);
+        if (n <= 0) return false;
+        p += n;
+        offset += (size_t)n;
+        size -= (size_t)n;
+    }
+    return true;
+#endif
+}
+
+// First fit; grows the file (and the mapping) when nothing fits.
+// Called with the exclusive lock held.
+uint32_t RegionFile::allocate(uint32_t sectors) {
+    uint32_t run = 0;
+    for (uint32_t s = headerSectors; s < usedSectors.size(); s++) {
+        run = usedSectors[s] ? 0 : run + 1;
+        if (run == sectors) return s + 1 - sectors;
+    }
+
+    uint32_t total = (uint32_t)usedSectors.size();
+    uint32_t start = total - run;
+    uint32_t grown = std::max(total * 2, start + sectors + MIN_GROWTH_SECTORS);
+    unmap();
+    std::vector<uint8_t> zeros(SECTOR_BYTES, 0);
+    bool ok = writeAt((size_t)grown * SECTOR_BYTES - zeros.size(), zeros.data(), zeros.size());
+    if (!map((size_t)grown * SECTOR_BYTES) || !ok) return 0;
+    usedSectors.resize(grown, false);
+    return start;
+}
+
+bool RegionFile::read(int index, std::vector<uint8_t>& out) const {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    const Entry& e = table[index];
+    if (e.sector == 0 || !mapped) return false;
+
+    const uint8_t* record = mapped + (size_t)e.sector * SECTOR_BYTES;
+    uint32_t rawBytes;
+    std::memcpy(&rawBytes, record, sizeof(rawBytes));
+    if (rawBytes > MAX_RAW_BYTES) return false;
+    out.resize(rawBytes);
+    return lz4Decompress(record + RECORD_HEADER, e.bytes - RECORD_HEADER, out.data(), rawBytes);
+}
+
+void RegionFile::prefetch(int index) const {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    const Entry& e = table[index];
+    if (e.sector == 0 || !mapped) return;
+
+    // One read per page is enough to bring it in
+    const uint8_t* record = mapped + (size_t)e.sector * SECTOR_BYTES;
+    volatile uint8_t sink = 0;
+    for (size_t at = 0; at < e.bytes; at += SECTOR_BYTES) sink = sink + record[at];
+}
+
+bool RegionFile::write(int index, const std::vector<uint8_t>& raw) {
+    // Compressed before taking the lock, readers only wait for the file update
+    lz4Compress(raw.data(), raw.size(), compressed);
+    uint32_t rawBytes = (uint32_t)raw.size();
+    size_t recordBytes = RECORD_HEADER + compressed.size();
+    uint32_t sectors = (uint32_t)((recordBytes + SECTOR_BYTES - 1) / SECTOR_BYTES);
+
+    std::unique_lock<std::shared_mutex> guard(lock);
+    uint32_t start = allocate(sectors);
+    if (start == 0) return false;
+    size_t offset = (size_t)start * SECTOR_BYTES;
+    if (!writeAt(offset, &rawBytes, sizeof(rawBytes))) return false;
+    if (!writeAt(offset + RECORD_HEADER, compressed.data(), compressed.size())) return false;
+
+    Entry e;
+    e.sector = start;
+    e.bytes = (uint32_t)recordBytes;
+    if (!writeAt(TABLE_OFFSET + (size_t)index * sizeof(Entry), &e, sizeof(e))) return false;
+    for (uint32_t s = 0; s < sectors; s++) usedSectors[start + s] = true;
+
+    // The old record's sectors are only reused once the table points elsewhere
+    Entry old = table[index];
+    if (old.sector) {
+        uint32_t count = (uint32_t)((old.bytes + SECTOR_BYTES - 1) / SECTOR_BYTES);
+        for (uint32_t s = 0; s < count; s++) usedSectors[old.sector + s] = false;
+    }
+    table[index] = e;
+    return true;
+}
+
+RegionStore::RegionStore(const std::string& directory) : dir(directory) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) std::cout << "Could not create " << dir << ": " << ec.message() << std::endl;
+    writer = std::thread([this]{ writerLoop(); });
+}
+
+RegionStore::~RegionStore() {
+    flush();
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        stop = true;
+    }
+    wake.notify_all();
+    writer.join();
+    if (prefetcher.joinable()) prefetcher.join();
+}
+
+static int regionCoord(int chunkCoord) {
+    return chunkCoord >= 0 ? chunkCoord / REGION_SIZE : (chunkCoord + 1) / REGION_SIZE - 1;
+}
+
+static int regionIndex(int cx, int cz) {
+    return (cx - regionCoord(cx) * REGION_SIZE) + REGION_SIZE * (cz - regionCoord(cz) * REGION_SIZE);
+}
+
+// Record slot inside the chunk or mesh file
+static int recordIndex(int cx, int cz, int section) {
+    return section < 0 ? regionIndex(cx, cz) : regionIndex(cx, cz) * MESH_SECTIONS + section;
+}
+
+RegionFile* RegionStore::region(int rx, int rz, bool meshes, bool create) {
+    auto& files = meshes ? meshRegions : regions;
+    uint64_t key = ChunkMap::packKey(rx, rz);
+    auto it = files.find(key);
+    if (it != files.end() && (it->second || !create)) return it->second.get();
+
+    std::string path = dir + (meshes ? "/m." : "/r.") + std::to_string(rx) + "." + std::to_string(rz) + ".region";
+    std::unique_ptr<RegionFile> file =
+        RegionFile::open(path, create, meshes ? REGION_CHUNKS * MESH_SECTIONS : REGION_CHUNKS);
+    RegionFile* result = file.get();
+    files[key] = std::move(file);
+    return result;
+}
+
+bool RegionStore::readRecord(const RecordKey& key, std::vector<uint8_t>& raw) {
+    int cx = ChunkMap::keyX(key.chunk);
+    int cz = ChunkMap::keyZ(key.chunk);
+    raw.clear();
+    RegionFile* file = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        auto it = pending.find(key);
+        if (it != pending.end()) {
+            raw = it->second.raw;
+            return true;
+        }
+        file = region(regionCoord(cx), regionCoord(cz), key.section >= 0, false);
+    }
+    return file && file->read(recordIndex(cx, cz, key.section), raw);
+}
+
+void RegionStore::queueRecord(const RecordKey& key, std::vector<uint8_t> raw) {
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        PendingWrite& p = pending[key];
+        p.raw = std::move(raw);
+        p.version = nextVersion++;
+        if (!p.queued) {
+            p.queued = true;
+            order.push_back(key);
+        }
+    }
+    wake.notify_one();
+}
+
+bool RegionStore::load(Chunk& chunk, bool& structuresDone) {
+    thread_local std::vector<uint8_t> raw;
+    RecordKey key;
+    key.chunk = ChunkMap::packKey(chunk.chunkX, chunk.chunkZ);
+    return readRecord(key, raw) && deserializeChunk(raw, chunk, structuresDone);
+}
+
+void RegionStore::save(const Chunk& chunk, bool structuresDone) {
+    std::vector<uint8_t> raw;
+    serializeChunk(chunk, structuresDone, raw);
+    RecordKey key;
+    key.chunk = ChunkMap::packKey(chunk.chunkX, chunk.chunkZ);
+    queueRecord(key, std::move(raw));
+}
+
+bool RegionStore::loadMesh(int cx, int cz, int section, uint64_t key, std::vector<PackedVertex>& vertices,
+                           MeshStats& stats) {
+    if (section < 0 || section >= MESH_SECTIONS) return false;
+    thread_local std::vector<uint8_t> raw;
+    RecordKey record;
+    record.chunk = ChunkMap::packKey(cx, cz);
+    record.section = section;
+    return readRecord(record, raw) && deserializeMesh(raw, key, vertices, stats);
+}
+
+void RegionStore::saveMesh(int cx, int cz, int section, uint64_t key, const std::vector<PackedVertex>& vertices,
+                           const MeshStats& stats) {
+    if (section < 0 || section >= MESH_SECTIONS) return;
+    std::vector<uint8_t> raw;
+    serializeMesh(key, vertices, stats, raw);
+    RecordKey record;
+    record.chunk = ChunkMap::packKey(cx, cz);
+    record.section = section;
+    queueRecord(record, std::move(raw));
+}
+
+void RegionStore::prefetch(int cx, int cz, int radius) {
+    if (prefetcher.joinable()) prefetcher.join();
+    prefetcher = std::thread([this, cx, cz, radius]() {
+        g_profiler.setThreadName("region prefetch");
+        PROFILE_SCOPE("region prefetch");
+        for (int z = cz - radius; z <= cz + radius; z++) {
+            for (int x = cx - radius; x <= cx + radius; x++) {
+                RegionFile* chunks;
+                RegionFile* meshes;
+                {
+                    std::lock_guard<std::mutex> guard(mtx);
+                    if (stop) return;
+                    chunks = region(regionCoord(x), regionCoord(z), false, false);
+                    meshes = region(regionCoord(x), regionCoord(z), true, false);
+                }
+                if (chunks) chunks->prefetch(recordIndex(x, z, -1));
+                for (int s = 0; meshes && s < MESH_SECTIONS; s++) meshes->prefetch(recordIndex(x, z, s));
+            }
+        }
+    });
+}
+
+void RegionStore::flush() {
+    std::unique_lock<std::mutex> guard(mtx);
+    drained.wait(guard, [this]{ return order.empty() && writing == 0; });
+}
+
+size_t RegionStore::queuedWrites() const {
+    std::lock_guard<std::mutex> guard(mtx);
+    return order.size() + writing;
+}
+
+void RegionStore::writerLoop() {
+    g_profiler.setThreadName("region writer");
+    std::vector<uint8_t> raw;
+    std::unique_lock<std::mutex> guard(mtx);
+    while (true) {
+        wake.wait(guard, [this]{ return stop || !order.empty(); });
+        if (order.empty()) {
+            if (stop) break;
+            continue;
+        }
+
+        RecordKey key = order.front();
+        order.pop_front();
+        PendingWrite& p = pending[key];
+        p.queued = false;
+        uint64_t version = p.version;
+        raw = p.raw;
+        writing++;
+
+        int cx = ChunkMap::keyX(key.chunk);
+        int cz = ChunkMap::keyZ(key.chunk);
+        RegionFile* file = region(regionCoord(cx), regionCoord(cz), key.section >= 0, true);
+        guard.unlock();
+        bool ok;
+        {
+            PROFILE_SCOPE("region write");
+            ok = file && file->write(recordIndex(cx, cz, key.section), raw);
+        }
+        guard.lock();
+        if (!ok) {
+            std::cout << "Failed to save " << (key.section < 0 ? "chunk " : "mesh of chunk ") << cx << ", " << cz
+                      << std::endl;
+        }
+
+        writing--;
+        // Keep serving loads from memory if the record was saved again meanwhile
+        auto it = pending.find(key);
+        if (it != pending.end() && it->second.version == version) pending.erase(it);
+        if (order.empty() && writing == 0) drained.notify_all();
+    }
+}
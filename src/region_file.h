@@ -0,0 +1,156 @@
+#pragma once
+#include "chunk.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// A region file holds REGION_SIZE x REGION_SIZE chunks. It starts with a
+// table giving, for every chunk, the sector its record starts at and the
+// record's length; records are LZ4 compressed serialized chunks in whole
+// 4 KiB sectors. A rewritten chunk goes to free sectors first and the
+// table entry is switched afterwards, so an interrupted write leaves the
+// previous record intact.
+constexpr int REGION_SIZE = 32;
+constexpr int REGION_CHUNKS = REGION_SIZE * REGION_SIZE;
+// Mesh files keep a record slot for every section a chunk can have
+constexpr int MESH_SECTIONS = 16;
+
+class RegionFile {
+public:
+    static constexpr size_t SECTOR_BYTES = 4096;
+
+    // nullptr if the file doesn't exist and create is false, or on I/O errors.
+    // entries is the number of records the table holds.
+    static std::unique_ptr<RegionFile> open(const std::string& path, bool create, int entries = REGION_CHUNKS);
+    ~RegionFile();
+
+    RegionFile(const RegionFile&) = delete;
+    RegionFile& operator=(const RegionFile&) = delete;
+
+    // Any thread. For chunk files index = localX + REGION_SIZE * localZ.
+    // Decompresses the record straight from the mapping into out; false if
+    // there is none.
+    bool read(int index, std::vector<uint8_t>& out) const;
+    // Any thread. Faults in the pages holding a record so a later read
+    // doesn't wait on the disk.
+    void prefetch(int index) const;
+    // Writer thread only
+    bool write(int index, const std::vector<uint8_t>& raw);
+
+private:
+    struct Entry {
+        uint32_t sector = 0; // 0 = no record
+        uint32_t bytes = 0;  // compressed record, header included
+    };
+
+    RegionFile() = default;
+    bool load(bool created);
+    bool map(size_t bytes);
+    void unmap();
+    bool writeAt(size_t offset, const void* data, size_t size);
+    uint32_t allocate(uint32_t sectors);
+
+    // Shared by readers, exclusive while the writer changes the file
+    mutable std::shared_mutex lock;
+    uint32_t headerSectors = 0;
+    std::vector<Entry> table;
+    std::vector<bool> usedSectors;
+    const uint8_t* mapped = nullptr;
+    size_t mappedBytes = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    std::vector<uint8_t> compressed; // writer scratch, record body
+};
+
+// Chunk persistence for one world. Loads run on whichever thread asks
+// (terrain jobs); saves are serialized on the calling thread and then
+// compressed and written by a single writer thread. A record queued for
+// writing is served from the queue until it is on disk.
+//
+// Next to the chunk data, mesh files (m.*.region) cache the vertices of
+// every section, each under the key of the content it was built from.
+class RegionStore {
+public:
+    explicit RegionStore(const std::string& directory);
+    ~RegionStore(); // writes everything still queued
+
+    // Any thread. Fills chunk from disk; structuresDone tells whether its
+    // structure stage already ran. False if the chunk was never saved or
+    // its record is unreadable.
+    bool load(Chunk& chunk, bool& structuresDone);
+    // Main thread, which must be the only writer of chunk's blocks
+    void save(const Chunk& chunk, bool structuresDone);
+
+    // Any thread. Fills vertices and stats with the cached mesh of a section
+    // if it was stored under the same key; see ChunkMesh::cacheKey.
+    bool loadMesh(int cx, int cz, int section, uint64_t key, std::vector<PackedVertex>& vertices,
+                  MeshStats& stats);
+    // Any thread
+    void saveMesh(int cx, int cz, int section, uint64_t key, const std::vector<PackedVertex>& vertices,
+                  const MeshStats& stats);
+
+    // Reads the chunk and mesh records of the square of chunks within radius
+    // of (cx, cz) into the page cache on a background job, so the first
+    // loads there don't wait on the disk
+    void prefetch(int cx, int cz, int radius);
+
+    // Blocks until the queue is empty
+    void flush();
+
+    size_t queuedWrites() const;
+
+private:
+    // A chunk's data, or the mesh of one of its sections
+    struct RecordKey {
+        uint64_t chunk = 0; // ChunkMap::packKey
+        int section = -1;   // -1 = chunk data
+
+        bool operator==(const RecordKey& o) const { return chunk == o.chunk && section == o.section; }
+    };
+    struct RecordKeyHash {
+        size_t operator()(const RecordKey& k) const {
+            return std::hash<uint64_t>()(k.chunk * 31 + (uint64_t)(k.section + 1));
+        }
+    };
+
+    struct PendingWrite {
+        std::vector<uint8_t> raw;
+        uint64_t version = 0; // bumped by every save of the record
+        bool queued = false;  // listed in order
+    };
+
+    // Under mtx. Mesh files when meshes is set.
+    RegionFile* region(int rx, int rz, bool meshes, bool create);
+    // Latest bytes of a record, from the queue or the file
+    bool readRecord(const RecordKey& key, std::vector<uint8_t>& raw);
+    void queueRecord(const RecordKey& key, std::vector<uint8_t> raw);
+    void writerLoop();
+
+    std::string dir;
+    mutable std::mutex mtx;
+    std::condition_variable wake;
+    std::condition_variable drained;
+    // Latest serialized state per record, in first-queued order
+    std::unordered_map<RecordKey, PendingWrite, RecordKeyHash> pending;
+    std::deque<RecordKey> order;
+    size_t writing = 0; // taken by the writer, not yet on disk
+    uint64_t nextVersion = 1;
+    // nullptr entries remember that a region file doesn't exist yet
+    std::unordered_map<uint64_t, std::unique_ptr<RegionFile>> regions;
+    std::unordered_map<uint64_t, std::unique_ptr<RegionFile>> meshRegions;
+    bool stop = false;
+    std::thread writer;
+    std::thread prefetcher; // see prefetch
+};
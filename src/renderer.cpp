@@ -1,22 +1,47 @@
 #include "renderer.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stbimage/stb_image.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <vector>
+#include "texture_atlas.h"
+
+static const char* ATLAS_PNG = "../src/textures/atlas.png";
+static const char* ATLAS_DDS = "../src/textures/atlas.dds";
+static const char* CACHE_DIR = "cache";
+static const char* ATLAS_CACHE = "cache/atlas.dds";
+static const char* PROGRAM_CACHE = "cache/program.bin";
 
 const char* vertexShaderSrc = R"(
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aUV;
+layout (location = 0) in uint aPacked;
+layout (location = 1) in vec3 aChunkOrigin; // per draw, see WorldBuffer
 
 out vec2 TexCoord;
+flat out float Layer;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    TexCoord = aUV;
+    // Layout matches packVertex() in chunk.h
+    vec3 local = vec3(float(aPacked & 31u), float((aPacked >> 5) & 255u), float((aPacked >> 13) & 31u));
+    uint face = (aPacked >> 18) & 7u;
+    uint rotation = (aPacked >> 21) & 3u;
+
+    // Tile-space uv follows the two axes spanning the face
+    vec2 uv = face < 2u ? local.xy : (face < 4u ? local.zy : local.xz);
+    if (rotation == 1u) uv = uv.yx;
+    else if (rotation == 2u) uv.x = -uv.x;
+
+    gl_Position = projection * view * model * vec4(aChunkOrigin + local - 0.5, 1.0);
+    TexCoord = uv;
+    Layer = float(aPacked >> 25);
 }
 )";
 
@@ -25,13 +50,93 @@ const char* fragmentShaderSrc = R"(
 out vec4 FragColor;
 
 in vec2 TexCoord;
-uniform sampler2D tex0;
+flat in float Layer;
+uniform sampler2DArray tex0;
 
 void main() {
-    FragColor = texture(tex0, TexCoord);
+    // TexCoord is in tile space; every tile is its own layer, so merged quads
+    // repeat it through GL_REPEAT
+    FragColor = texture(tex0, vec3(TexCoord, Layer));
 }
 )";
 
+// Driver-specific program binary, valid only for these exact sources on the
+// driver that produced it
+struct ProgramCacheHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint64_t key;
+    uint32_t length;
+    uint32_t reserved;
+};
+static const uint32_t PROGRAM_CACHE_MAGIC = 0x42505856; // "VXPB"
+
+static uint64_t hashString(uint64_t h, const char* s) {
+    for (; s && *s; s++) h = (h ^ (uint8_t)*s) * 0x100000001b3ull;
+    return (h ^ 0xff) * 0x100000001b3ull;
+}
+
+static uint64_t programCacheKey() {
+    uint64_t h = 0xcbf29ce484222325ull;
+    h = hashString(h, vertexShaderSrc);
+    h = hashString(h, fragmentShaderSrc);
+    h = hashString(h, (const char*)glGetString(GL_VENDOR));
+    h = hashString(h, (const char*)glGetString(GL_RENDERER));
+    return hashString(h, (const char*)glGetString(GL_VERSION));
+}
+
+static bool programBinarySupported() {
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+static std::vector<uint8_t> readFile(const char* path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return {};
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// One layer per atlas tile, numbered like TextureAtlas::getLayer. Rows
+// count from the bottom of the image, which the flip puts first.
+static bool decodeAtlasPng(const char* path, TextureArray& out) {
+    int width, height, channels;
+    stbi_set_flip_vertically_on_load(true);
+    unsigned char* data = stbi_load(path, &width, &height, &channels, 4);
+    if (!data) return false;
+
+    const AtlasConfig& atlas = g_textureAtlas.getConfig();
+    const int tileW = width / atlas.columns;
+    const int tileH = height / atlas.rows;
+    const int layers = g_textureAtlas.layerCount();
+    std::vector<uint8_t> tiles((size_t)tileW * tileH * 4 * layers);
+    for (int layer = 0; layer < layers; layer++) {
+        int column = layer % atlas.columns;
+        int row = layer / atlas.columns;
+        for (int y = 0; y < tileH; y++) {
+            const unsigned char* src = data + (((size_t)(row * tileH + y) * width) + column * tileW) * 4;
+            std::copy(src, src + tileW * 4, tiles.begin() + ((size_t)layer * tileH + y) * tileW * 4);
+        }
+    }
+    stbi_image_free(data);
+
+    out = TextureArray();
+    out.width = tileW;
+    out.height = tileH;
+    out.layers = layers;
+    out.mips.push_back(std::move(tiles));
+    return true;
+}
+
+static bool newerThan(const char* path, const char* other) {
+    std::error_code error;
+    auto a = std::filesystem::last_write_time(path, error);
+    if (error) return false;
+    auto b = std::filesystem::last_write_time(other, error);
+    return error || a >= b;
+}
+
 Renderer::Renderer() : shaderProgram(0), atlasTexture(0) {
 }
 
@@ -40,12 +145,45 @@ Renderer::~Renderer() {
     if (atlasTexture) glDeleteTextures(1, &atlasTexture);
 }
 
-bool Renderer::initialize() {
-    shaderProgram = createShaderProgram();
-    if (!shaderProgram) return false;
+RendererAssets Renderer::loadAssets() {
+    RendererAssets assets;
+    assets.programCache = readFile(PROGRAM_CACHE);
+
+    // Files with a different tile count belong to another atlas layout
+    const int layers = g_textureAtlas.layerCount();
+    if (loadDds(ATLAS_DDS, assets.atlas) && assets.atlas.layers == layers) {
+        assets.atlasSource = ATLAS_DDS;
+    } else if (newerThan(ATLAS_CACHE, ATLAS_PNG) && loadDds(ATLAS_CACHE, assets.atlas) &&
+               assets.atlas.layers == layers) {
+        assets.atlasSource = ATLAS_CACHE;
+    } else if (decodeAtlasPng(ATLAS_PNG, assets.atlas)) {
+        assets.atlasSource = ATLAS_PNG;
+    } else {
+        assets.atlas = TextureArray();
+    }
+    return assets;
+}
+
+bool Renderer::initialize(RendererAssets assets) {
+    shaderProgram = loadProgramBinary(assets.programCache);
+    programFromCache = shaderProgram != 0;
+    if (!shaderProgram) {
+        shaderProgram = createShaderProgram();
+        if (!shaderProgram) return false;
+        saveProgramBinary(shaderProgram);
+    }
 
-    atlasTexture = loadTexture("../src/textures/atlas.png");
-    if (!atlasTexture) return false;
+    atlasSource = assets.atlasSource;
+    atlasTexture = assets.atlas.empty() ? 0 : uploadTexture(assets.atlas);
+    if (!atlasTexture && std::strcmp(atlasSource, ATLAS_PNG) != 0) {
+        // e.g. a BC7 atlas on a driver without BPTC
+        atlasSource = ATLAS_PNG;
+        if (decodeAtlasPng(ATLAS_PNG, assets.atlas)) atlasTexture = uploadTexture(assets.atlas);
+    }
+    if (!atlasTexture) {
+        std::cout << "Failed to load texture: " << ATLAS_PNG << std::endl;
+        return false;
+    }
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
@@ -78,6 +216,7 @@ unsigned int Renderer::createShaderProgram() {
     unsigned int program = glCreateProgram();
     glAttachShader(program, vs);
     glAttachShader(program, fs);
+    if (programBinarySupported()) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
 
     int success;
@@ -93,33 +232,114 @@ unsigned int Renderer::createShaderProgram() {
     return program;
 }
 
-GLuint Renderer::loadTexture(const char* path) {
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, channels;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char* data = stbi_load(path, &width, &height, &channels, 0);
+// 0 if there is no cache, it was written for other sources or another
+// driver, or the driver rejects it (drivers may after an update)
+unsigned int Renderer::loadProgramBinary(const std::vector<uint8_t>& cache) {
+    ProgramCacheHeader header;
+    if (cache.size() < sizeof(header) || !programBinarySupported()) return 0;
+    std::memcpy(&header, cache.data(), sizeof(header));
+    if (header.magic != PROGRAM_CACHE_MAGIC || header.key != programCacheKey() ||
+        header.length != cache.size() - sizeof(header)) {
+        return 0;
+    }
 
-    if (!data) {
-        std::cout << "Failed to load texture: " << path << std::endl;
+    unsigned int program = glCreateProgram();
+    glProgramBinary(program, header.format, cache.data() + sizeof(header), (GLsizei)header.length);
+    int success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
         return 0;
     }
+    return program;
+}
 
-    GLenum format;
-    if (channels == 1)      format = GL_RED;
-    else if (channels == 3) format = GL_RGB;
-    else if (channels == 4) format = GL_RGBA;
+void Renderer::saveProgramBinary(unsigned int program) {
+    int linked = 0;
+    GLint length = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked || !programBinarySupported()) return;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
 
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    ProgramCacheHeader header = { PROGRAM_CACHE_MAGIC, 0, programCacheKey(), 0, 0 };
+    std::vector<uint8_t> binary((size_t)length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0) return;
+    header.format = format;
+    header.length = (uint32_t)written;
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    std::error_code error;
+    std::filesystem::create_directories(CACHE_DIR, error);
+    std::ofstream file(PROGRAM_CACHE, std::ios::binary | std::ios::trunc);
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)binary.data(), written);
+}
+
+// Uploads every stored level. A lone RGBA8 level (the decoded PNG) gets its
+// chain from glGenerateMipmap, which is then read back into the cache so the
+// next start skips both the decode and the generation.
+GLuint Renderer::uploadTexture(TextureArray& atlas) {
+    GLenum compressed = 0;
+    switch (atlas.format) {
+        case TextureFormat::BC1:
+            if (!GLEW_EXT_texture_compression_s3tc) return 0;
+            compressed = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            break;
+        case TextureFormat::BC3:
+            if (!GLEW_EXT_texture_compression_s3tc) return 0;
+            compressed = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            break;
+        case TextureFormat::BC7:
+            if (!GLEW_VERSION_4_2 && !GLEW_ARB_texture_compression_bptc) return 0;
+            compressed = GL_COMPRESSED_RGBA_BPTC_UNORM;
+            break;
+        default:
+            break;
+    }
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    const int levels = (int)atlas.mips.size();
+    for (int level = 0; level < levels; level++) {
+        int w = std::max(1, atlas.width >> level);
+        int h = std::max(1, atlas.height >> level);
+        const uint8_t* data = atlas.mips[level].data();
+        if (compressed) {
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, compressed, w, h, atlas.layers, 0,
+                                   (GLsizei)(atlas.layerBytes(level) * atlas.layers), data);
+        } else {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, w, h, atlas.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (levels == 1 && !compressed) {
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        int full = 1;
+        while ((atlas.width | atlas.height) >> full) full++;
+        atlas.mips.resize(full);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        for (int level = 1; level < full; level++) {
+            atlas.mips[level].resize(atlas.layerBytes(level) * atlas.layers);
+            glGetTexImage(GL_TEXTURE_2D_ARRAY, level, GL_RGBA, GL_UNSIGNED_BYTE, atlas.mips[level].data());
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        std::error_code error;
+        std::filesystem::create_directories(CACHE_DIR, error);
+        saveDds(ATLAS_CACHE, atlas);
+    } else {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-    stbi_image_free(data);
     return textureID;
-}
\ No newline at end of file
+}
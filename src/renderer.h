@@ -1,20 +1,41 @@
 #pragma once
 #include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+#include "texture_file.h"
+
+// Everything the renderer reads from disk, loaded without a GL context so
+// it can happen on another thread while the window is being created
+struct RendererAssets {
+    TextureArray atlas;              // empty if nothing could be read
+    const char* atlasSource = "";    // which file it came from
+    std::vector<uint8_t> programCache;
+};
 
 class Renderer {
 public:
     unsigned int shaderProgram;
     GLuint atlasTexture;
+    // For the startup report
+    const char* atlasSource = "";
+    bool programFromCache = false;
 
     Renderer();
     ~Renderer();
 
-    bool initialize();
+    // Prefers a shipped precompressed atlas.dds, then the decoded and
+    // mipmapped cache/atlas.dds from an earlier run, then atlas.png
+    static RendererAssets loadAssets();
+
+    bool initialize(RendererAssets assets);
+    bool initialize() { return initialize(loadAssets()); }
     unsigned int getShaderProgram() const { return shaderProgram; }
     GLuint getAtlasTexture() const { return atlasTexture; }
 
 private:
     unsigned int compileShader(unsigned int type, const char* src);
     unsigned int createShaderProgram();
-    GLuint loadTexture(const char* path);
-};
\ No newline at end of file
+    unsigned int loadProgramBinary(const std::vector<uint8_t>& cache);
+    void saveProgramBinary(unsigned int program);
+    GLuint uploadTexture(TextureArray& atlas);
+};
@@ -0,0 +1,238 @@
+#include "telemetry.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using SocketHandle = SOCKET;
+static const SocketHandle NO_SOCKET = INVALID_SOCKET;
+static void closeSocket(SocketHandle s) { closesocket(s); }
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using SocketHandle = int;
+static const SocketHandle NO_SOCKET = -1;
+static void closeSocket(SocketHandle s) { close(s); }
+#endif
+
+// A backend that drops the connection mid-post must not raise SIGPIPE,
+// which would end the game: Linux takes a flag per send, macOS a socket
+// option
+#if defined(MSG_NOSIGNAL)
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+static void suppressSigpipe(SocketHandle s) {
+#if defined(SO_NOSIGPIPE)
+    int on = 1;
+    setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+    (void)s;
+#endif
+}
+
+// Deadline for a whole post: connecting, sending and reading the reply.
+// Name lookup is outside it, getaddrinfo can't be given a timeout; a
+// numeric host skips the lookup.
+static const int TIMEOUT_MS = 2000;
+static const float MAX_BACKOFF_SECONDS = 30.0f;
+
+TelemetryClient::TelemetryClient(const std::string& endpoint, const std::string& source, float intervalSeconds)
+    : source(source), interval(std::max(0.1f, intervalSeconds)) {
+    size_t colon = endpoint.rfind(':');
+    host = endpoint.substr(0, colon);
+    port = colon == std::string::npos ? 80 : std::atoi(endpoint.c_str() + colon + 1);
+    sender = std::thread([this]() { senderLoop(); });
+}
+
+TelemetryClient::~TelemetryClient() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    wake.notify_all();
+    sender.join();
+}
+
+void TelemetryClient::record(float frameMillis, const std::vector<std::pair<const char*, float>>& stages) {
+    Sample s;
+    s.time = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    s.frameMillis = frameMillis;
+    s.stageCount = (int)std::min(stages.size(), (size_t)MAX_STAGES);
+    for (int i = 0; i < s.stageCount; i++) s.stages[i] = { stages[i].first, stages[i].second };
+    if (!queue.tryPush(std::move(s))) dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TelemetryClient::senderLoop() {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+    std::vector<Sample> batch;
+    float wait = interval;
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+        wake.wait_for(lock, std::chrono::duration<float>(wait), [this]{ return stop; });
+        bool stopping = stop;
+        lock.unlock();
+
+        batch.clear();
+        queue.popBatch(batch);
+        if (!batch.empty()) {
+            if (post(encode(batch))) {
+                sent.fetch_add(batch.size(), std::memory_order_relaxed);
+                failing.store(false, std::memory_order_relaxed);
+                wait = interval;
+            } else {
+                // Samples are only worth something while they are current
+                dropped.fetch_add(batch.size(), std::memory_order_relaxed);
+                failing.store(true, std::memory_order_relaxed);
+                wait = std::min(wait * 2.0f, MAX_BACKOFF_SECONDS);
+            }
+        }
+
+        lock.lock();
+        if (stopping) break;
+    }
+    lock.unlock();
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+static void appendJsonString(std::string& out, const char* s) {
+    out += '"';
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') out += '\\';
+        if ((unsigned char)*s >= 0x20) out += *s;
+    }
+    out += '"';
+}
+
+// {"source": ..., "samples": [{"t": ..., "frame_ms": ..., "stages": {name: ms, ...}}, ...]}
+std::string TelemetryClient::encode(const std::vector<Sample>& batch) const {
+    std::string out;
+    out.reserve(64 + batch.size() * 160);
+    out += "{\"source\":";
+    appendJsonString(out, source.c_str());
+    out += ",\"samples\":[";
+    char number[64];
+    for (size_t i = 0; i < batch.size(); i++) {
+        const Sample& s = batch[i];
+        std::snprintf(number, sizeof(number), "%s{\"t\":%.3f,\"frame_ms\":%.3f,\"stages\":{", i ? "," : "", s.time,
+                      s.frameMillis);
+        out += number;
+        for (int k = 0; k < s.stageCount; k++) {
+            if (k) out += ',';
+            appendJsonString(out, s.stages[k].name);
+            std::snprintf(number, sizeof(number), ":%.3f", s.stages[k].millis);
+            out += number;
+        }
+        out += "}}";
+    }
+    out += "]}";
+    return out;
+}
+
+static void setNonBlocking(SocketHandle s, bool on) {
+#ifdef _WIN32
+    u_long mode = on ? 1 : 0;
+    ioctlsocket(s, FIONBIO, &mode);
+#else
+    int flags = fcntl(s, F_GETFL, 0);
+    fcntl(s, F_SETFL, on ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+#endif
+}
+
+using Deadline = std::chrono::steady_clock::time_point;
+
+// Waits until s is writable (or readable); false once the deadline passes
+// or on error
+static bool waitFor(SocketHandle s, bool write, Deadline deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+    if (left.count() <= 0) return false;
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(s, &set);
+    timeval tv;
+    tv.tv_sec = (long)(left.count() / 1000000);
+    tv.tv_usec = (long)(left.count() % 1000000);
+    int n = select((int)s + 1, write ? nullptr : &set, write ? &set : nullptr, nullptr, &tv);
+    return n > 0;
+}
+
+bool TelemetryClient::post(const std::string& body) {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) return false;
+    Deadline deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TIMEOUT_MS);
+
+    SocketHandle s = NO_SOCKET;
+    for (addrinfo* a = addresses; a && s == NO_SOCKET; a = a->ai_next) {
+        s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (s == NO_SOCKET) continue;
+        suppressSigpipe(s);
+        // Connect with a timeout, so an unreachable host can't hold up shutdown
+        setNonBlocking(s, true);
+        bool connected = connect(s, a->ai_addr, (int)a->ai_addrlen) == 0;
+        if (!connected && waitFor(s, true, deadline)) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            connected = getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&error, &length) == 0 && error == 0;
+        }
+        if (!connected) {
+            closeSocket(s);
+            s = NO_SOCKET;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (s == NO_SOCKET) return false;
+
+    std::string request = "POST /ingest/batch HTTP/1.1\r\nHost: " + host + ":" + std::to_string(port) +
+                          "\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) +
+                          "\r\nConnection: close\r\n\r\n" + body;
+    bool ok = true;
+    size_t offset = 0;
+    while (ok && offset < request.size()) {
+        if (!waitFor(s, true, deadline)) {
+            ok = false;
+            break;
+        }
+        int n = (int)send(s, request.data() + offset, (int)(request.size() - offset), SEND_FLAGS);
+        if (n <= 0) ok = false;
+        else offset += (size_t)n;
+    }
+
+    // Only the status line matters, but the reply is read to the end so the
+    // server isn't reset while it writes
+    char status[32] = {};
+    char reply[1024];
+    size_t got = 0;
+    size_t total = 0;
+    while (ok && total < 64 * 1024) {
+        if (!waitFor(s, false, deadline)) {
+            ok = false;
+            break;
+        }
+        int n = (int)recv(s, reply, (int)sizeof(reply), 0);
+        if (n <= 0) break;
+        size_t keep = std::min((size_t)n, sizeof(status) - 1 - got);
+        std::memcpy(status + got, reply, keep);
+        got += keep;
+        total += (size_t)n;
+    }
+    closeSocket(s);
+    // "HTTP/1.1 200 OK"
+    return ok && got >= 12 && std::strncmp(status, "HTTP/1.", 7) == 0 && status[9] == '2';
+}
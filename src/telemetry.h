@@ -0,0 +1,69 @@
+#pragma once
+#include "mpsc_queue.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Sends frame times and stage timings to the dashboard backend
+// (backend/server.py, POST /ingest/batch). The render loop only copies a
+// fixed-size sample into a lock-free queue; a background thread batches
+// whatever arrived and posts it once per interval. A full queue or a
+// failed post drops samples instead of ever waiting, and failures back
+// off, so a missing backend costs nothing.
+class TelemetryClient {
+public:
+    static constexpr int MAX_STAGES = 12;
+
+    struct Stage {
+        const char* name = nullptr; // string literal, see PROFILE_SCOPE
+        float millis = 0.0f;
+    };
+
+    struct Sample {
+        double time = 0.0; // seconds since the Unix epoch
+        float frameMillis = 0.0f;
+        int stageCount = 0;
+        Stage stages[MAX_STAGES];
+    };
+
+    // host:port of the backend, e.g. "127.0.0.1:8000". source names this
+    // machine in the dashboard.
+    TelemetryClient(const std::string& endpoint, const std::string& source, float intervalSeconds = 1.0f);
+    ~TelemetryClient(); // posts what is still queued
+
+    TelemetryClient(const TelemetryClient&) = delete;
+    TelemetryClient& operator=(const TelemetryClient&) = delete;
+
+    // Render thread, once per frame. Never blocks.
+    void record(float frameMillis, const std::vector<std::pair<const char*, float>>& stages);
+
+    size_t sentSamples() const { return sent.load(std::memory_order_relaxed); }
+    size_t droppedSamples() const { return dropped.load(std::memory_order_relaxed); }
+    bool lastPostFailed() const { return failing.load(std::memory_order_relaxed); }
+
+private:
+    void senderLoop();
+    std::string encode(const std::vector<Sample>& batch) const;
+    bool post(const std::string& body);
+
+    std::string host;
+    int port = 0;
+    std::string source;
+    float interval;
+
+    MpscQueue<Sample> queue{4096};
+    std::atomic<size_t> sent{0};
+    std::atomic<size_t> dropped{0};
+    std::atomic<bool> failing{false};
+
+    std::mutex mtx;
+    std::condition_variable wake;
+    bool stop = false;
+    std::thread sender;
+};
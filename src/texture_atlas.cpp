@@ -1,9 +1,16 @@
 #include "texture_atlas.h"
+#include "block_storage.h"
 
 TextureAtlas g_textureAtlas;
 
 TextureAtlas::TextureAtlas() {
     initializeTextures();
+    for (int type = 0; type < BLOCK_TYPE_COUNT; type++) {
+        for (int face = 0; face < 6; face++) {
+            faceLayers[type][face] = (uint8_t)getLayer(blockTextures[type][face]);
+            layout = hashMix(layout, faceLayers[type][face]);
+        }
+    }
 }
 
 void TextureAtlas::initializeTextures() {
@@ -77,18 +84,14 @@ void TextureAtlas::initializeTextures() {
     }
 }
 
-AtlasTexture TextureAtlas::getTexture(BlockType type, int faceIndex) const {
-    auto it = blockTextures.find(type);
-    if (it != blockTextures.end()) {
-        return it->second[faceIndex];
-    }
-    return AtlasTexture(0, 0);
-}
-
 float TextureAtlas::getUOffset(const AtlasTexture& tex) const {
     return tex.column * config.getUScale();
 }
 
 float TextureAtlas::getVOffset(const AtlasTexture& tex) const {
     return tex.row * config.getVScale();
+}
+
+int TextureAtlas::getLayer(const AtlasTexture& tex) const {
+    return tex.row * config.columns + tex.column;
 }
\ No newline at end of file
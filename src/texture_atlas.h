@@ -1,7 +1,7 @@
 #pragma once
 #include "block.h"
-#include <unordered_map>
 #include <string>
+#include <cstdint>
 
 struct AtlasConfig {
     int columns = 1;
@@ -22,17 +22,28 @@ class TextureAtlas {
 public:
     TextureAtlas();
 
-    AtlasTexture getTexture(BlockType type, int faceIndex) const;
+    AtlasTexture getTexture(BlockType type, int faceIndex) const { return blockTextures[type][faceIndex]; }
+    // Texture array layer of a block face, baked once; this is what the
+    // mesher looks up per face
+    int faceLayer(BlockType type, int faceIndex) const { return faceLayers[type][faceIndex]; }
+    int layerCount() const { return config.columns * config.rows; }
 
     float getUOffset(const AtlasTexture& tex) const;
     float getVOffset(const AtlasTexture& tex) const;
+    int getLayer(const AtlasTexture& tex) const;
 
     const AtlasConfig& getConfig() const { return config; }
 
+    // Changes whenever any block face maps to a different layer; part of
+    // the key of cached meshes
+    uint64_t layoutHash() const { return layout; }
+
 private:
     AtlasConfig config;
+    uint64_t layout = 0;
 
-    std::unordered_map<BlockType, AtlasTexture[6]> blockTextures;
+    AtlasTexture blockTextures[BLOCK_TYPE_COUNT][6];
+    uint8_t faceLayers[BLOCK_TYPE_COUNT][6] = {};
 
     void initializeTextures();
 };
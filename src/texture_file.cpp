@@ -0,0 +1,171 @@
+#include "texture_file.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000;
+const uint32_t DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+const uint32_t DDPF_ALPHAPIXELS = 0x1, DDPF_FOURCC = 0x4, DDPF_RGB = 0x40;
+const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+const uint32_t DXGI_R8G8B8A8_UNORM = 28, DXGI_R8G8B8A8_UNORM_SRGB = 29;
+const uint32_t DXGI_BC1_UNORM = 71, DXGI_BC1_UNORM_SRGB = 72;
+const uint32_t DXGI_BC3_UNORM = 77, DXGI_BC3_UNORM_SRGB = 78;
+const uint32_t DXGI_BC7_UNORM = 98, DXGI_BC7_UNORM_SRGB = 99;
+const uint32_t DIMENSION_TEXTURE2D = 3;
+// Past what GL guarantees anyway; keeps a corrupt header from asking for
+// gigabytes before the length check
+const uint32_t MAX_SIZE = 16384;
+const uint32_t MAX_LAYERS = 2048;
+
+constexpr uint32_t fourCC(char a, char b, char c, char d) {
+    return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+}
+
+struct PixelFormat {
+    uint32_t size, flags, fourCC, rgbBitCount, rMask, gMask, bMask, aMask;
+};
+
+struct Header {
+    uint32_t size, flags, height, width, pitchOrLinearSize, depth, mipMapCount;
+    uint32_t reserved1[11];
+    PixelFormat format;
+    uint32_t caps, caps2, caps3, caps4, reserved2;
+};
+
+struct HeaderDx10 {
+    uint32_t dxgiFormat, resourceDimension, miscFlag, arraySize, miscFlags2;
+};
+
+static_assert(sizeof(Header) == 124, "DDS header layout");
+static_assert(sizeof(HeaderDx10) == 20, "DDS DX10 header layout");
+
+bool fromDxgi(uint32_t dxgi, TextureFormat& out) {
+    switch (dxgi) {
+        case DXGI_R8G8B8A8_UNORM: case DXGI_R8G8B8A8_UNORM_SRGB: out = TextureFormat::RGBA8; return true;
+        case DXGI_BC1_UNORM: case DXGI_BC1_UNORM_SRGB: out = TextureFormat::BC1; return true;
+        case DXGI_BC3_UNORM: case DXGI_BC3_UNORM_SRGB: out = TextureFormat::BC3; return true;
+        case DXGI_BC7_UNORM: case DXGI_BC7_UNORM_SRGB: out = TextureFormat::BC7; return true;
+        default: return false;
+    }
+}
+
+uint32_t toDxgi(TextureFormat format) {
+    switch (format) {
+        case TextureFormat::BC1: return DXGI_BC1_UNORM;
+        case TextureFormat::BC3: return DXGI_BC3_UNORM;
+        case TextureFormat::BC7: return DXGI_BC7_UNORM;
+        default: return DXGI_R8G8B8A8_UNORM;
+    }
+}
+
+} // namespace
+
+size_t TextureArray::layerBytes(int level) const {
+    size_t w = (size_t)std::max(1, width >> level);
+    size_t h = (size_t)std::max(1, height >> level);
+    switch (format) {
+        case TextureFormat::BC1: return ((w + 3) / 4) * ((h + 3) / 4) * 8;
+        case TextureFormat::BC3:
+        case TextureFormat::BC7: return ((w + 3) / 4) * ((h + 3) / 4) * 16;
+        default: return w * h * 4;
+    }
+}
+
+bool loadDds(const std::string& path, TextureArray& out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    const uint8_t* p = bytes.data();
+    const uint8_t* end = p + bytes.size();
+    uint32_t magic;
+    Header header;
+    if (bytes.size() < sizeof(magic) + sizeof(header)) return false;
+    std::memcpy(&magic, p, sizeof(magic));
+    std::memcpy(&header, p + sizeof(magic), sizeof(header));
+    p += sizeof(magic) + sizeof(header);
+    if (magic != DDS_MAGIC || header.size != sizeof(Header) || header.width == 0 || header.height == 0 ||
+        header.width > MAX_SIZE || header.height > MAX_SIZE) {
+        return false;
+    }
+
+    TextureArray texture;
+    texture.width = (int)header.width;
+    texture.height = (int)header.height;
+    texture.layers = 1;
+    const PixelFormat& pf = header.format;
+    if ((pf.flags & DDPF_FOURCC) && pf.fourCC == fourCC('D', 'X', '1', '0')) {
+        HeaderDx10 dx10;
+        if ((size_t)(end - p) < sizeof(dx10)) return false;
+        std::memcpy(&dx10, p, sizeof(dx10));
+        p += sizeof(dx10);
+        if (dx10.resourceDimension != DIMENSION_TEXTURE2D || !fromDxgi(dx10.dxgiFormat, texture.format)) return false;
+        if (dx10.arraySize > MAX_LAYERS) return false;
+        texture.layers = (int)std::max(1u, dx10.arraySize);
+    } else if (pf.flags & DDPF_FOURCC) {
+        if (pf.fourCC == fourCC('D', 'X', 'T', '1')) texture.format = TextureFormat::BC1;
+        else if (pf.fourCC == fourCC('D', 'X', 'T', '5')) texture.format = TextureFormat::BC3;
+        else return false;
+    } else if ((pf.flags & DDPF_RGB) && pf.rgbBitCount == 32 && pf.rMask == 0xFF && pf.gMask == 0xFF00 &&
+               pf.bMask == 0xFF0000 && pf.aMask == 0xFF000000u) {
+        texture.format = TextureFormat::RGBA8;
+    } else {
+        return false;
+    }
+
+    // Stored layer by layer, each with its whole chain; kept level by level
+    // No more levels than it takes to reach 1x1, and all of them in the file
+    int fullChain = 1;
+    while ((texture.width | texture.height) >> fullChain) fullChain++;
+    uint32_t storedLevels = (header.flags & DDSD_MIPMAPCOUNT) ? header.mipMapCount : 1;
+    int levels = (int)std::min<uint32_t>(std::max(1u, storedLevels), (uint32_t)fullChain);
+    size_t total = 0;
+    for (int level = 0; level < levels; level++) total += texture.layerBytes(level) * texture.layers;
+    if ((size_t)(end - p) < total) return false;
+    texture.mips.resize(levels);
+    for (int level = 0; level < levels; level++) texture.mips[level].resize(texture.layerBytes(level) * texture.layers);
+    for (int layer = 0; layer < texture.layers; layer++) {
+        for (int level = 0; level < levels; level++) {
+            size_t n = texture.layerBytes(level);
+            std::memcpy(texture.mips[level].data() + n * layer, p, n);
+            p += n;
+        }
+    }
+    out = std::move(texture);
+    return true;
+}
+
+bool saveDds(const std::string& path, const TextureArray& texture) {
+    if (texture.empty()) return false;
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    header.size = sizeof(Header);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.width = (uint32_t)texture.width;
+    header.height = (uint32_t)texture.height;
+    header.pitchOrLinearSize = (uint32_t)texture.layerBytes(0);
+    header.mipMapCount = (uint32_t)texture.mips.size();
+    header.format.size = sizeof(PixelFormat);
+    header.format.flags = DDPF_FOURCC;
+    header.format.fourCC = fourCC('D', 'X', '1', '0');
+    header.caps = DDSCAPS_TEXTURE | (texture.mips.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+    HeaderDx10 dx10 = { toDxgi(texture.format), DIMENSION_TEXTURE2D, 0, (uint32_t)texture.layers, 0 };
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+    file.write((const char*)&DDS_MAGIC, sizeof(DDS_MAGIC));
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)&dx10, sizeof(dx10));
+    for (int layer = 0; layer < texture.layers; layer++) {
+        for (int level = 0; level < (int)texture.mips.size(); level++) {
+            size_t n = texture.layerBytes(level);
+            if (texture.mips[level].size() < n * texture.layers) return false;
+            file.write((const char*)texture.mips[level].data() + n * layer, (std::streamsize)n);
+        }
+    }
+    return (bool)file;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class TextureFormat {
+    RGBA8,
+    BC1,  // DXT1
+    BC3,  // DXT5
+    BC7
+};
+
+// A 2D texture array with however much of its mip chain was stored. Rows
+// run bottom to top, the order OpenGL uploads them in.
+struct TextureArray {
+    TextureFormat format = TextureFormat::RGBA8;
+    int width = 0;
+    int height = 0;
+    int layers = 0;
+    // mips[level] holds every layer of that level, one after another
+    std::vector<std::vector<uint8_t>> mips;
+
+    bool empty() const { return mips.empty(); }
+    size_t layerBytes(int level) const;
+};
+
+// DDS with a DX10 header (texture arrays, BC7) or a legacy DXT1/DXT5/RGBA8
+// header. Files are read as-is, with no decoding, so rows must already be
+// bottom to top (texconv -vflip). False if the file is missing, malformed
+// or in another format.
+bool loadDds(const std::string& path, TextureArray& out);
+bool saveDds(const std::string& path, const TextureArray& texture);
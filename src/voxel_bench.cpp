@@ -0,0 +1,234 @@
+// Headless benchmark of the world code: terrain, trees and meshing
+// throughput, then a scripted fly-through of updateChunks. Needs no window
+// or GL context. Results go to stdout as one JSON object so runs can be
+// compared between releases; progress goes to stderr.
+//
+//   voxel_bench [--seed N] [--chunks N] [--radius N] [--threads N]
+//               [--frames N] [--speed BLOCKS_PER_SECOND]
+#include "world.h"
+#include "job_system.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    unsigned int seed = 1337;
+    int chunks = 64;     // per throughput test
+    int radius = 8;      // fly-through render distance
+    int threads = 0;     // 0 = job system default
+    int frames = 1200;   // fly-through length, 60 per simulated second
+    float speed = 20.0f; // fly-through speed in blocks per second
+};
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t i = (size_t)(p * (double)(values.size() - 1) + 0.5);
+    return values[std::min(i, values.size() - 1)];
+}
+
+size_t chunkVoxels() {
+    Chunk c;
+    return (size_t)c.width * c.height * c.depth;
+}
+
+// One throughput result: count chunks took seconds
+void printRate(const char* name, int count, double seconds, bool last) {
+    double perChunk = seconds / count;
+    std::printf("    \"%s\": {\"chunks\": %d, \"seconds\": %.6f, \"chunks_per_second\": %.1f, "
+                "\"ns_per_voxel\": %.3f}%s\n",
+                name, count, seconds, count / seconds, perChunk * 1e9 / (double)chunkVoxels(), last ? "" : ",");
+}
+
+// Chunk positions in a square around the origin, row by row
+void gridPosition(int i, int side, int& cx, int& cz) {
+    cx = i % side - side / 2;
+    cz = i / side - side / 2;
+}
+
+void benchTerrainAndTrees(const Options& opt) {
+    int side = 1;
+    while (side * side < opt.chunks) side++;
+
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    for (int i = 0; i < opt.chunks; i++) {
+        int cx, cz;
+        gridPosition(i, side, cx, cz);
+        chunks.push_back(std::make_unique<Chunk>(cx, cz));
+    }
+
+    auto start = Clock::now();
+    for (auto& c : chunks) generateTerrainForChunk(*c);
+    double terrain = secondsSince(start);
+
+    std::vector<StructureEdit> edits;
+    size_t editCount = 0;
+    start = Clock::now();
+    for (const auto& c : chunks) {
+        edits.clear();
+        generateTrees(*c, edits);
+        editCount += edits.size();
+    }
+    double trees = secondsSince(start);
+
+    printRate("terrain", opt.chunks, terrain, false);
+    printRate("trees", opt.chunks, trees, false);
+    std::printf("    \"tree_edits_per_chunk\": %.1f,\n", (double)editCount / opt.chunks);
+}
+
+// Meshes the inner chunks of a generated square, whose ring of neighbours
+// is there so boundary faces are culled like in the game
+void benchMeshing(const Options& opt) {
+    int side = 1;
+    while (side * side < opt.chunks) side++;
+
+    ChunkManager manager;
+    std::vector<ManagedChunk*> inner;
+    for (int z = -1; z <= side; z++) {
+        for (int x = -1; x <= side; x++) {
+            ManagedChunk* mc = manager.acquireChunk(x, z);
+            generateTerrainForChunk(mc->chunk);
+            manager.addChunk(x, z, mc);
+            if (x >= 0 && x < side && z >= 0 && z < side && (int)inner.size() < opt.chunks) inner.push_back(mc);
+        }
+    }
+
+    const MeshingMode modes[] = { MeshingMode::PerFace, MeshingMode::Greedy };
+    const char* names[] = { "mesh_per_face", "mesh_greedy" };
+    std::vector<PackedVertex> vertices;
+    for (int m = 0; m < 2; m++) {
+        g_meshingMode.store(modes[m]);
+        size_t vertexCount = 0;
+        size_t quads = 0;
+        auto start = Clock::now();
+        for (ManagedChunk* mc : inner) {
+            for (int s = 0; s < mc->chunk.sectionCount(); s++) {
+                MeshStats stats;
+                ChunkMesh::buildVertices(mc->chunk, &manager, s, vertices, &stats);
+                vertexCount += vertices.size();
+                quads += stats.quads;
+            }
+        }
+        double seconds = secondsSince(start);
+        int count = (int)inner.size();
+        std::printf("    \"%s\": {\"chunks\": %d, \"seconds\": %.6f, \"chunks_per_second\": %.1f, "
+                    "\"ns_per_voxel\": %.3f, \"quads_per_chunk\": %.1f, \"vertex_bytes_per_chunk\": %.1f},\n",
+                    names[m], count, seconds, count / seconds, seconds / count * 1e9 / (double)chunkVoxels(),
+                    (double)quads / count, (double)vertexCount * sizeof(PackedVertex) / count);
+    }
+    g_meshingMode.store(MeshingMode::Greedy);
+}
+
+// Does what MeshUploadQueue::process does for the game, minus the upload
+void finishMeshes(ChunkManager& manager, std::vector<CompletedMesh>& batch, size_t& meshed) {
+    batch.clear();
+    g_completedMeshes.popBatch(batch);
+    for (CompletedMesh& m : batch) {
+        ManagedChunk* mc = manager.getChunk(m.cx, m.cz);
+        if (!mc || mc->id != m.chunkId) continue;
+        if (m.generation == mc->generations[m.section]) {
+            ChunkMesh& mesh = mc->meshes[m.section];
+            mesh.uploadToGPU(m.vertices);
+            mesh.stats = m.stats;
+            meshed++;
+        }
+        mc->queuedSections &= ~(1u << m.section);
+        if (mc->dirtySections) manager.requestRemesh(mc);
+    }
+}
+
+// Straight line along +x at a fixed speed, one updateChunks per simulated
+// 60 Hz frame. The frame's remaining time is slept so workers progress at
+// the rate they would in the game.
+void benchFlyThrough(const Options& opt) {
+    ChunkManager manager;
+    std::vector<CompletedMesh> batch;
+    std::vector<double> millis;
+    millis.reserve(opt.frames);
+    size_t meshed = 0;
+    size_t peakChunks = 0;
+    const double frameSeconds = 1.0 / 60.0;
+    glm::vec3 pos(8.0f, 100.0f, 8.0f);
+
+    auto start = Clock::now();
+    for (int f = 0; f < opt.frames; f++) {
+        auto frameStart = Clock::now();
+        updateChunks(manager, pos, opt.radius, 0);
+        millis.push_back(std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count());
+        finishMeshes(manager, batch, meshed);
+        peakChunks = std::max(peakChunks, manager.chunks.size());
+
+        pos.x += opt.speed * (float)frameSeconds;
+        auto frameEnd = frameStart + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(frameSeconds));
+        std::this_thread::sleep_until(frameEnd);
+        if (f % 600 == 599) std::fprintf(stderr, "fly-through: %d/%d frames\n", f + 1, opt.frames);
+    }
+    double seconds = secondsSince(start);
+
+    std::printf("    \"fly_through\": {\"frames\": %d, \"radius\": %d, \"speed\": %.1f, \"seconds\": %.3f, "
+                "\"update_ms_p50\": %.3f, \"update_ms_p99\": %.3f, \"update_ms_max\": %.3f, "
+                "\"sections_meshed\": %zu, \"peak_chunks\": %zu}\n",
+                opt.frames, opt.radius, opt.speed, seconds, percentile(millis, 0.5), percentile(millis, 0.99),
+                percentile(millis, 1.0), meshed, peakChunks);
+
+    // Workers may still hold chunks of this manager; pendingCount() alone
+    // misses jobs that are already running
+    manager.cancelJobs();
+    getJobSystem().waitIdle();
+    g_completedMeshes.popBatch(batch);
+}
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "missing value for %s\n", arg);
+            return false;
+        }
+        const char* value = argv[++i];
+        if (!std::strcmp(arg, "--seed")) opt.seed = (unsigned int)std::strtoul(value, nullptr, 10);
+        else if (!std::strcmp(arg, "--chunks")) opt.chunks = std::max(1, std::atoi(value));
+        else if (!std::strcmp(arg, "--radius")) opt.radius = std::max(1, std::atoi(value));
+        else if (!std::strcmp(arg, "--threads")) opt.threads = std::max(0, std::atoi(value));
+        else if (!std::strcmp(arg, "--frames")) opt.frames = std::max(1, std::atoi(value));
+        else if (!std::strcmp(arg, "--speed")) opt.speed = (float)std::atof(value);
+        else {
+            std::fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) return 1;
+
+    if (opt.threads > 0) initJobSystem((size_t)opt.threads);
+    initPerlin(opt.seed);
+
+    std::printf("{\n  \"seed\": %u,\n  \"threads\": %zu,\n  \"results\": {\n", opt.seed,
+                getJobSystem().workerCount());
+    benchTerrainAndTrees(opt);
+    benchMeshing(opt);
+    benchFlyThrough(opt);
+    std::printf("  }\n}\n");
+    shutdownJobSystem();
+    return 0;
+}
@@ -1,218 +1,37 @@
 #include "world.h"
+#include "job_system.h"
+#include "profiler.h"
 #include <cmath>
 #include <cstdlib>
 #include <vector>
 #include <algorithm>
+#include <memory>
 #include <thread>
 #include <queue>
 #include <mutex>
-#include <condition_variable>
 #include <atomic>
-#include <functional>
 #include <cmath>
 // Async
-class ThreadPool {
-public:
-    explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency()) {
-        if (threadCount == 0) threadCount = 1;
-        for (size_t i = 0; i < threadCount; ++i) {
-            workers.emplace_back([this]{ this->workerLoop(); });
-        }
-    }
-    ~ThreadPool() {
-        stop.store(true);
-        cv.notify_all();
-        for (auto& t : workers) if (t.joinable()) t.join();
-    }
-    void enqueue(std::function<void()> job) {
-        {
-            std::lock_guard<std::mutex> lock(mtx);
-            jobs.push(std::move(job));
-        }
-        cv.notify_one();
-    }
-private:
-    void workerLoop() {
-        while (!stop.load()) {
-            std::function<void()> job;
-            {
-                std::unique_lock<std::mutex> lock(mtx);
-                cv.wait(lock, [this]{ return stop.load() || !jobs.empty(); });
-                if (stop.load()) break;
-                job = std::move(jobs.front());
-                jobs.pop();
-            }
-            if (job) job();
-        }
-    }
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> jobs;
-    std::mutex mtx;
-    std::condition_variable cv;
-    std::atomic<bool> stop{false};
-};
-
-void CompletedMeshQueue::push(CompletedMesh m) {
-    std::lock_guard<std::mutex> lock(mtx);
-    q.push(std::move(m));
-}
-
-bool CompletedMeshQueue::try_pop(CompletedMesh& out) {
-    std::lock_guard<std::mutex> lock(mtx);
-    if (q.empty()) return false;
-    out = std::move(q.front());
-    q.pop();
-    return true;
-}
-
-struct CompletedTerrain {
-    int cx;
-    int cz;
-};
-
-class CompletedTerrainQueue {
-public:
-    void push(CompletedTerrain t) {
-        std::lock_guard<std::mutex> lock(mtx);
-        q.push(t);
-    }
-    bool try_pop(CompletedTerrain& out) {
-        std::lock_guard<std::mutex> lock(mtx);
-        if (q.empty()) return false;
-        out = q.front();
-        q.pop();
-        return true;
-    }
-private:
-    std::mutex mtx;
-    std::queue<CompletedTerrain> q;
-};
-
-CompletedTerrainQueue g_completedTerrain;
-
-static ThreadPool* g_pool = nullptr;
-ThreadPool& getThreadPool() {
-    if (!g_pool) {
-        size_t n = std::thread::hardware_concurrency();
-        size_t threads = (n > 1) ? (n - 1) : 1;
-        g_pool = new ThreadPool(threads);
-    }
-    return *g_pool;
-}
-
-CompletedMeshQueue g_completedMeshes;
-
-int perm[512];
-
-void initPerlin(unsigned int seed) {
-    std::srand(seed);
-    std::vector<int> p(256);
-    for (int i = 0; i < 256; i++) p[i] = i;
+// Sized well above what a frame of workers can produce; a full queue makes
+// producers wait for the main thread.
+CompletedTerrainQueue g_completedTerrain(1024);
+CompletedStructuresQueue g_completedStructures(1024);
+CompletedMeshQueue g_completedMeshes(4096);
+std::atomic<MeshStagingFn> g_meshStaging{nullptr};
 
-    for (int i = 255; i > 0; i--) {
-        int j = std::rand() % (i + 1);
-        std::swap(p[i], p[j]);
-    }
-
-    for (int i = 0; i < 512; i++) perm[i] = p[i & 255];
-}
-
-float fade(float t) {
-    return t * t * t * (t * (t * 6 - 15) + 10);
+static inline float clampf(float x, float a, float b) {
+    return std::max(a, std::min(x, b));
 }
 
-float lerp(float a, float b, float t) {
+static inline float lerpf(float a, float b, float t) {
     return a + t * (b - a);
 }
 
-static inline float clampf(float x, float a, float b) {
-    return std::max(a, std::min(x, b));
-}
-
 static inline float smoothstepf(float edge0, float edge1, float x) {
     float t = clampf((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
     return t * t * (3.0f - 2.0f * t);
 }
 
-float grad(int hash, float x, float y) {
-    int h = hash & 7;
-    float u = h < 4 ? x : y;
-    float v = h < 4 ? y : x;
-    return ((h & 1) ? -u : u) + ((h & 2) ? -2.0f*v : 2.0f*v);
-}
-
-float grad3(int hash, float x, float y, float z) {
-    int h = hash & 15;
-    float u = h < 8 ? x : y;
-    float v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
-    return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
-}
-
-
-float perlin(float x, float y) {
-    int X = (int)floor(x) & 255;
-    int Y = (int)floor(y) & 255;
-
-    x -= floor(x);
-    y -= floor(y);
-
-    float u = fade(x);
-    float v = fade(y);
-
-    int aa = perm[X + perm[Y]];
-    int ab = perm[X + perm[Y + 1]];
-    int ba = perm[X + 1 + perm[Y]];
-    int bb = perm[X + 1 + perm[Y + 1]];
-
-    float res = lerp(
-        lerp(grad(aa, x, y), grad(ba, x - 1, y), u),
-        lerp(grad(ab, x, y - 1), grad(bb, x - 1, y - 1), u),
-        v
-    );
-
-    return res;
-}
-
-float perlin3(float x, float y, float z) {
-    int X = (int)floor(x) & 255;
-    int Y = (int)floor(y) & 255;
-    int Z = (int)floor(z) & 255;
-
-    x -= floor(x);
-    y -= floor(y);
-    z -= floor(z);
-
-    float u = fade(x);
-    float v = fade(y);
-    float w = fade(z);
-
-    int A  = perm[X] + Y;
-    int AA = perm[A] + Z;
-    int AB = perm[A + 1] + Z;
-
-    int B  = perm[X + 1] + Y;
-    int BA = perm[B] + Z;
-    int BB = perm[B + 1] + Z;
-
-    float res =
-        lerp(
-            lerp(
-                lerp(grad3(perm[AA], x,     y,     z),
-                     grad3(perm[BA], x-1.0, y,     z), u),
-                lerp(grad3(perm[AB], x,     y-1.0, z),
-                     grad3(perm[BB], x-1.0, y-1.0, z), u),
-                v),
-            lerp(
-                lerp(grad3(perm[AA+1], x,     y,     z-1.0),
-                     grad3(perm[BA+1], x-1.0, y,     z-1.0), u),
-                lerp(grad3(perm[AB+1], x,     y-1.0, z-1.0),
-                     grad3(perm[BB+1], x-1.0, y-1.0, z-1.0), u),
-                v),
-            w);
-
-    return res;
-}
-
 float getTerrainHeight(int worldX, int worldZ) {
     float scale = 0.05f;
     float amplitude = 10.0f;
@@ -222,11 +41,12 @@ float getTerrainHeight(int worldX, int worldZ) {
     return baseHeight + n * amplitude;
 }
 
-float getMountOffset(int worldX, int worldZ) {
-    const float mountScale = 0.015f;
+const float mountScale = 0.015f;
+const float biomeScale = 0.0015f;
+
+static float mountOffsetFromNoise(float mountN) {
     const float mountAmp   = 32.0f;
     const float mountMask = 0.75f;
-    float mountN = perlin(worldX * mountScale - 120.0f, worldZ * mountScale + 53.0f);
     float Offset = ((mountN - mountMask)/(1.0f - mountMask)) * mountAmp;
     if (mountN < mountMask) {
         Offset = 0.0f;
@@ -234,6 +54,18 @@ float getMountOffset(int worldX, int worldZ) {
     return Offset;
 }
 
+static BiomeType biomeFromNoise(float mountOffset, float biomeN) {
+    if (mountOffset != 0.0f) {
+        return MOUNTAIN;
+    }
+    float n = (biomeN + 1.0f) / 2.0f;
+    return (n < 0.5f) ? PLAINS : FOREST;
+}
+
+float getMountOffset(int worldX, int worldZ) {
+    return mountOffsetFromNoise(perlin(worldX * mountScale - 120.0f, worldZ * mountScale + 53.0f));
+}
+
 // Simple 32-bit integer hash
 static uint32_t hash32(uint32_t x) {
     x ^= x >> 16;
@@ -263,54 +95,58 @@ NoiseOffset makeNoiseOffset(uint32_t seed) {
 }
 
 
-bool blockNoise(
-    float worldX, float worldY, float worldZ,
-    float scale, float mask,
-    const NoiseOffset& off
-) {
-    float n = perlin3(
-        worldX * scale + off.ox,
-        worldY * scale + off.oy,
-        worldZ * scale + off.oz
-    );
-
-    return n > mask;
-}
-
-
-
+// For single columns; chunks read the biomes terrain generation cached
 BiomeType getBiome(int worldX, int worldZ) {
-    if (getMountOffset(worldX, worldZ) != 0.0f) {
-        return MOUNTAIN;
-    }
-    float scale = 0.0015f;
-    float n = perlin(worldX * scale + 500, worldZ * scale + 500);
-    n = (n + 1.0f) / 2.0f;
-
-    return (n < 0.5f) ? PLAINS : FOREST;
+    return biomeFromNoise(getMountOffset(worldX, worldZ), perlin(worldX * biomeScale + 500, worldZ * biomeScale + 500));
 }
 
 int getChunkCoord(float worldPos) {
     return (int)std::floor(worldPos / 16.0f);
 }
 
-ManagedChunk* ChunkManager::getChunk(int cx, int cz) {
-    auto key = std::make_pair(cx, cz);
-    auto it = chunks.find(key);
-    if(it == chunks.end()) return nullptr;
-    return it->second;
+void ChunkManager::addChunk(int cx, int cz, ManagedChunk* chunk) {
+    chunk->id = nextChunkId++;
+    chunks.insert(cx, cz, chunk);
 }
 
-void ChunkManager::addChunk(int cx, int cz, ManagedChunk* chunk) {
-    chunks[{cx, cz}] = chunk;
+void ChunkManager::save(ManagedChunk* mc) {
+    if (!regions || !mc->unsaved || !mc->reached(ChunkState::Terrain)) return;
+    regions->save(mc->chunk, mc->reached(ChunkState::Structures));
+    mc->unsaved = false;
+}
+
+void ChunkManager::saveAll() {
+    for (const ChunkMap::Slot& slot : chunks) save(slot.chunk);
 }
 
 void ChunkManager::removeChunk(int cx, int cz) {
-    auto key = std::make_pair(cx, cz);
-    auto it = chunks.find(key);
-    if (it != chunks.end()) {
-        delete it->second;
-        chunks.erase(it);
+    if (ManagedChunk* mc = chunks.erase(cx, cz)) {
+        save(mc);
+        mc->jobs->cancel();
+        retired.push_back(mc);
+    }
+}
+
+ManagedChunk* ChunkManager::acquireChunk(int cx, int cz) {
+    if (pool.empty()) return new ManagedChunk(cx, cz);
+    ManagedChunk* mc = pool.back();
+    pool.pop_back();
+    mc->reset(cx, cz);
+    return mc;
+}
+
+void ChunkManager::freeRetired() {
+    size_t kept = 0;
+    for (ManagedChunk* mc : retired) {
+        if (!mc->jobs->idle()) retired[kept++] = mc;
+        else if (pool.size() < poolCap) pool.push_back(mc);
+        else delete mc;
+    }
+    retired.resize(kept);
+    // The cap may have been lowered
+    while (pool.size() > poolCap) {
+        delete pool.back();
+        pool.pop_back();
     }
 }
 
@@ -323,10 +159,44 @@ std::vector<ManagedChunk*> ChunkManager::getNeighbors4(int cx, int cz) {
     return out;
 }
 
+ManagedChunk* ChunkManager::resolve(const ChunkRef& ref) {
+    ManagedChunk* mc = getChunk(ref.cx, ref.cz);
+    return (mc && mc->id == ref.id) ? mc : nullptr;
+}
+
+void ChunkManager::requestRemesh(ManagedChunk* mc) {
+    if (mc->inRemeshList) return;
+    mc->inRemeshList = true;
+    remeshList.push_back({mc->chunk.chunkX, mc->chunk.chunkZ, mc->id});
+}
+
+void ChunkManager::addNeighbourhood(std::vector<ChunkRef>& list, int cx, int cz) {
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            if (ManagedChunk* n = getChunk(cx + dx, cz + dz)) list.push_back({cx + dx, cz + dz, n->id});
+        }
+    }
+}
+
+void ChunkManager::cancelJobs() {
+    // Structures jobs point at their chunk, mesh jobs at the manager
+    for (const ChunkMap::Slot& slot : chunks) slot.chunk->jobs->cancel();
+    for (ManagedChunk* mc : retired) mc->jobs->cancel();
+    for (const ChunkMap::Slot& slot : chunks) {
+        while (!slot.chunk->jobs->idle()) std::this_thread::yield();
+    }
+    for (ManagedChunk* mc : retired) {
+        while (!mc->jobs->idle()) std::this_thread::yield();
+    }
+}
+
 ChunkManager::~ChunkManager() {
-    for(auto& pair : chunks) {
-        delete pair.second;
+    cancelJobs();
+    for (const ChunkMap::Slot& slot : chunks) {
+        delete slot.chunk;
     }
+    for (ManagedChunk* mc : retired) delete mc;
+    for (ManagedChunk* mc : pool) delete mc;
 }
 
 void setBlockWorld(ChunkManager* manager, int worldX, int y, int worldZ, BlockType type,
@@ -342,186 +212,385 @@ void setBlockWorld(ChunkManager* manager, int worldX, int y, int worldZ, BlockTy
     if (localX < 0 || localX >= (int)mc->chunk.width || localZ < 0 || localZ >= (int)mc->chunk.depth) return;
     if (y < 0 || y >= (int)mc->chunk.height) return;
 
-    mc->chunk.getBlock(localX, y, localZ).type = type;
-    mc->chunk.getBlock(localX, y, localZ).axis = axis;
+    Block block;
+    block.type = type;
+    block.axis = axis;
+    {
+        std::unique_lock<std::shared_mutex> lock(mc->chunk.lock);
+        mc->chunk.setBlock(localX, y, localZ, block);
+    }
 
-    mc->meshDirty = true;
+    mc->markBlockDirty(y);
+    mc->unsaved = true;
+    manager->requestRemesh(mc);
     if (modified) modified->insert({cx, cz});
 }
 
-void generateTerrainForChunk(Chunk& chunk) {
-    for (int x = 0; x < (int)chunk.width; x++) {
-        for (int z = 0; z < (int)chunk.depth; z++) {
-            int worldX = chunk.chunkX * chunk.width + x;
-            int worldZ = chunk.chunkZ * chunk.depth + z;
-
-            const float baseHeight = 48.0f;
-
-            const float macroScale = 0.0012f;
-            const float macroAmp   = 20.0f;
-            float macroN = perlin(worldX * macroScale, worldZ * macroScale);
-            float macroOffset = macroN * macroAmp;
-
-            const float regionScale = 0.0035f;
-            const float regionAmp   = 6.0f;
-            float regionN = perlin(worldX * regionScale + 37.0f, worldZ * regionScale - 91.0f);
-            float regionOffset = regionN * regionAmp;
-
-            const float maskScale = 0.010f;
-            float maskRaw = perlin(worldX * maskScale + 200.0f, worldZ * maskScale + 200.0f);
-            float mask01 = (maskRaw + 1.0f) * 0.5f;
-
-            const float maskThreshold = 0.62f;
-            const float maskFeather   = 0.08f;
-            float hillMask = smoothstepf(maskThreshold, maskThreshold + maskFeather, mask01);
-
-            const float detailScale = 0.05f;
-            const float detailAmp   = 2.0f;
-            float detailN = perlin(worldX * detailScale - 120.0f, worldZ * detailScale + 53.0f);
-            float detailOffset = detailN * detailAmp;
-
-            //const float mountScale = 0.015f;
-            //const float mountAmp   = 32.0f;
-            //const float mountMask = 0.75f;
-            //float mountN = perlin(worldX * mountScale - 120.0f, worldZ * mountScale + 53.0f);
-            //float mountOffset = pow(((mountN - mountMask)/mountMask),0.9) * mountAmp;
-            //float mountOffset = ((mountN - mountMask)/(1.0f - mountMask)) * mountAmp;
-            //if (mountN < mountMask) {
-            //    mountOffset = 0.0f;
-            //}
-            float mountOffset = getMountOffset(worldX, worldZ);
-
-            const float hillScale = 0.07f;
-            const float hillAmp   = 14.0f;
-            float hillN = perlin(worldX * hillScale + 777.0f, worldZ * hillScale - 333.0f);
-            float hillOnlyUp = ((hillN + 1.0f) * 0.5f) * hillAmp;
-            float hillOffset = hillOnlyUp * hillMask;
-
-            //int terrainHeight = int(baseHeight + macroOffset + regionOffset + detailOffset + hillOffset);
-            int terrainHeight = int(baseHeight + macroOffset + regionOffset + detailOffset + hillOffset + mountOffset);
-            //int terrainHeight = int(baseHeight + macroOffset + mountOffset + regionOffset + hillOffset);
-            //int terrainHeight = int(mountOffset);
-
-            if (terrainHeight >= (int)chunk.height) terrainHeight = chunk.height - 1;
-
-            float localVariationMag = std::fabs(detailOffset) + hillMask * 0.5f * hillAmp;
-            int minDirt = 2;
-            int maxDirt = 5;
-            int dirtDepth = minDirt + int(clampf(localVariationMag / (hillAmp + detailAmp), 0.0f, 1.0f) * (maxDirt - minDirt));
-
-            int stoneThreshold = int(baseHeight + macroOffset + regionAmp * 0.8f);
-            if (terrainHeight > stoneThreshold) {
-                dirtDepth = std::max(dirtDepth - (terrainHeight - stoneThreshold) / 2, 1);
-            }
+std::atomic<OreNoiseMode> g_oreNoiseMode{OreNoiseMode::Exact};
+std::atomic<bool> g_skipHiddenOres{false};
+std::atomic<bool> g_meshCacheEnabled{true};
+std::atomic<unsigned int> g_meshCacheHits{0};
+std::atomic<unsigned int> g_meshCacheMisses{0};
 
-            if (dirtDepth > terrainHeight) dirtDepth = terrainHeight;
+namespace {
 
-            uint32_t blockSeed = 1234567;
-
-            NoiseOffset graniteOffset = makeNoiseOffset(blockSeed + 10);
-            NoiseOffset dioriteOffset = makeNoiseOffset(blockSeed + 20);
-            NoiseOffset andesiteOffset = makeNoiseOffset(blockSeed + 30);
-            NoiseOffset tuffOffset    = makeNoiseOffset(blockSeed + 40);
-
-            for (int y = 0; y < (int)chunk.height; y++) {
-                if (y > terrainHeight)
-                    chunk.setBlock(x, y, z, AIR);
-
-                else if (mountOffset > 0.0f) {
-                    if (y == terrainHeight)
-                        chunk.setBlock(x, y, z, COARSE_DIRT);
+struct TerrainColumn {
+    int height;   // surface block
+    int stoneTop; // first layer above the stone; veins only below it
+    bool mountain;
+    uint8_t biome;
+};
 
-                    else if (blockNoise(worldX, y, worldZ, 0.05f, 0.4f, graniteOffset))
-                        chunk.setBlock(x, y, z, GRANITE);
+// Ore lattice spacing for OreNoiseMode::Coarse, in blocks. Lattice points
+// sit on world multiples of ORE_CELL, so neighbouring chunks agree on the
+// shared faces.
+constexpr int ORE_CELL = 4;
+
+} // namespace
+
+// Samples the surface of a w x d grid of columns, column (x, z) sitting at
+// world (worldX0 + x * step, worldZ0 + z * step). Heights are capped below
+// maxHeight.
+static void sampleTerrainColumns(int worldX0, int worldZ0, int w, int d, int step, int maxHeight,
+                                 std::vector<TerrainColumn>& shape) {
+    const float baseHeight = 48.0f;
+    const float macroScale = 0.0012f;
+    const float macroAmp   = 20.0f;
+    const float regionScale = 0.0035f;
+    const float regionAmp   = 6.0f;
+    const float maskScale = 0.010f;
+    const float maskThreshold = 0.62f;
+    const float maskFeather   = 0.08f;
+    const float detailScale = 0.05f;
+    const float detailAmp   = 2.0f;
+    const float hillScale = 0.07f;
+    const float hillAmp   = 14.0f;
+
+    // Every 2D layer is sampled in one batch
+    const size_t count = (size_t)w * d;
+    std::vector<float> macroN(count), regionN(count), maskRaw(count), detailN(count),
+                       mountN(count), hillN(count), biomeN(count);
+    perlinColumns(worldX0, worldZ0, w, d, macroScale, 0.0f, 0.0f, macroN.data(), step);
+    perlinColumns(worldX0, worldZ0, w, d, regionScale, 37.0f, -91.0f, regionN.data(), step);
+    perlinColumns(worldX0, worldZ0, w, d, maskScale, 200.0f, 200.0f, maskRaw.data(), step);
+    perlinColumns(worldX0, worldZ0, w, d, detailScale, -120.0f, 53.0f, detailN.data(), step);
+    perlinColumns(worldX0, worldZ0, w, d, mountScale, -120.0f, 53.0f, mountN.data(), step);
+    perlinColumns(worldX0, worldZ0, w, d, hillScale, 777.0f, -333.0f, hillN.data(), step);
+    perlinColumns(worldX0, worldZ0, w, d, biomeScale, 500.0f, 500.0f, biomeN.data(), step);
+
+    shape.resize(count);
+    for (size_t column = 0; column < count; column++) {
+        float macroOffset = macroN[column] * macroAmp;
+        float regionOffset = regionN[column] * regionAmp;
+
+        float mask01 = (maskRaw[column] + 1.0f) * 0.5f;
+        float hillMask = smoothstepf(maskThreshold, maskThreshold + maskFeather, mask01);
+
+        float detailOffset = detailN[column] * detailAmp;
+        float mountOffset = mountOffsetFromNoise(mountN[column]);
+
+        float hillOnlyUp = ((hillN[column] + 1.0f) * 0.5f) * hillAmp;
+        float hillOffset = hillOnlyUp * hillMask;
+
+        int terrainHeight = int(baseHeight + macroOffset + regionOffset + detailOffset + hillOffset + mountOffset);
+        if (terrainHeight >= maxHeight) terrainHeight = maxHeight - 1;
+
+        float localVariationMag = std::fabs(detailOffset) + hillMask * 0.5f * hillAmp;
+        int minDirt = 2;
+        int maxDirt = 5;
+        int dirtDepth = minDirt + int(clampf(localVariationMag / (hillAmp + detailAmp), 0.0f, 1.0f) * (maxDirt - minDirt));
+
+        int stoneThreshold = int(baseHeight + macroOffset + regionAmp * 0.8f);
+        if (terrainHeight > stoneThreshold) {
+            dirtDepth = std::max(dirtDepth - (terrainHeight - stoneThreshold) / 2, 1);
+        }
 
-                    else if (blockNoise(worldX, y, worldZ, 0.05f, 0.4f, andesiteOffset))
-                        chunk.setBlock(x, y, z, ANDESITE);
+        if (dirtDepth > terrainHeight) dirtDepth = terrainHeight;
 
-                    else if (blockNoise(worldX, y, worldZ, 0.05f, 0.4f, tuffOffset))
-                        chunk.setBlock(x, y, z, TUFF);
+        TerrainColumn& c = shape[column];
+        c.height = terrainHeight;
+        // Mountains have no dirt
+        c.mountain = mountOffset > 0.0f;
+        c.stoneTop = c.mountain ? terrainHeight : terrainHeight - dirtDepth;
+        c.biome = (uint8_t)biomeFromNoise(mountOffset, biomeN[column]);
+    }
+}
 
-                    else if (blockNoise(worldX, y, worldZ, 0.05f, 0.4f, dioriteOffset))
-                        chunk.setBlock(x, y, z, DIORITE);
+void generateTerrainForChunk(Chunk& chunk) {
+    const int w = (int)chunk.width;
+    const int d = (int)chunk.depth;
+    const int worldX0 = chunk.chunkX * w;
+    const int worldZ0 = chunk.chunkZ * d;
+
+    const float oreScale = 0.05f;
+    const float oreMask = 0.4f;
+
+    const OreNoiseMode oreMode = g_oreNoiseMode.load(std::memory_order_relaxed);
+    const bool skipHidden = g_skipHiddenOres.load(std::memory_order_relaxed);
+
+    // The chunk plus a one column border, so hidden stone can be told from
+    // exposed stone
+    const int pw = w + 2;
+    const int pd = d + 2;
+    std::vector<TerrainColumn> shape;
+    sampleTerrainColumns(worldX0 - 1, worldZ0 - 1, pw, pd, 1, (int)chunk.height, shape);
+    auto columnAt = [&](int x, int z) -> const TerrainColumn& { return shape[(size_t)(x + 1) + pw * (z + 1)]; };
+
+    // The lowest layer of each column whose stone can touch air: anything
+    // below every side neighbour's surface is buried (there are no caves)
+    std::vector<int> oreStart((size_t)w * d, 0);
+    int yLow = (int)chunk.height;
+    int yHigh = 0;
+    for (int z = 0; z < d; z++) {
+        for (int x = 0; x < w; x++) {
+            const TerrainColumn& c = columnAt(x, z);
+            int start = 0;
+            if (skipHidden) {
+                int lowest = std::min(std::min(columnAt(x - 1, z).height, columnAt(x + 1, z).height),
+                                      std::min(columnAt(x, z - 1).height, columnAt(x, z + 1).height));
+                start = std::max(lowest + 1, 0);
+            }
+            oreStart[(size_t)x + w * z] = start;
+            if (start < c.stoneTop) {
+                yLow = std::min(yLow, start);
+                yHigh = std::max(yHigh, c.stoneTop);
+            }
+        }
+    }
 
-                    else
-                        chunk.setBlock(x, y, z, STONE);
+    const uint32_t blockSeed = 1234567;
+    const NoiseOffset veinOffsets[4] = {
+        makeNoiseOffset(blockSeed + 10), // granite
+        makeNoiseOffset(blockSeed + 30), // andesite
+        makeNoiseOffset(blockSeed + 40), // tuff
+        makeNoiseOffset(blockSeed + 20), // diorite
+    };
+    const BlockType veinTypes[4] = { GRANITE, ANDESITE, TUFF, DIORITE };
+
+    // Sample positions for perlin3Batch
+    std::vector<float> sx, sy, sz;
+
+    // Coarse mode samples the veins once per lattice point over the layers
+    // in use, then interpolates per column and layer
+    const int gw = w / ORE_CELL + 1;
+    const int gd = d / ORE_CELL + 1;
+    int layer0 = 0;
+    int layers = 0;
+    std::vector<float> lattice[4];
+    if (oreMode == OreNoiseMode::Coarse && yLow < yHigh) {
+        layer0 = yLow / ORE_CELL;
+        layers = (yHigh - 1) / ORE_CELL + 2 - layer0;
+        for (int v = 0; v < 4; v++) {
+            const NoiseOffset& off = veinOffsets[v];
+            sx.clear();
+            sy.clear();
+            sz.clear();
+            for (int j = 0; j < layers; j++) {
+                for (int gz = 0; gz < gd; gz++) {
+                    for (int gx = 0; gx < gw; gx++) {
+                        sx.push_back((float)(worldX0 + gx * ORE_CELL) * oreScale + off.ox);
+                        sy.push_back((float)((layer0 + j) * ORE_CELL) * oreScale + off.oy);
+                        sz.push_back((float)(worldZ0 + gz * ORE_CELL) * oreScale + off.oz);
+                    }
                 }
+            }
+            lattice[v].resize(sx.size());
+            perlin3Batch(sx.data(), sy.data(), sz.data(), lattice[v].data(), sx.size());
+        }
+    }
 
-                else if (y == terrainHeight)
-                    chunk.setBlock(x, y, z, GRASS);
-
-                else if (y >= terrainHeight - dirtDepth)
-                    chunk.setBlock(x, y, z, DIRT);
-
-                else if (blockNoise(worldX, y, worldZ, 0.05f, 0.4f, graniteOffset))
-                    chunk.setBlock(x, y, z, GRANITE);
+    chunk.heightmap.assign((size_t)w * d, 0);
+    chunk.biomes.assign((size_t)w * d, PLAINS);
+
+    std::vector<float> veins[4];
+    std::vector<float> columnLayers;
+    for (int x = 0; x < w; x++) {
+        for (int z = 0; z < d; z++) {
+            const TerrainColumn& c = columnAt(x, z);
+            size_t column = (size_t)x + w * z;
+            int worldX = worldX0 + x;
+            int worldZ = worldZ0 + z;
+
+            chunk.heightmap[column] = (uint8_t)std::max(c.height, 0);
+            chunk.biomes[column] = c.biome;
+
+            int start = oreStart[column];
+            if (start < c.stoneTop) {
+                for (int v = 0; v < 4; v++) {
+                    veins[v].resize(c.stoneTop);
+                    const NoiseOffset& off = veinOffsets[v];
+                    if (oreMode == OreNoiseMode::Exact) {
+                        int count = c.stoneTop - start;
+                        sx.assign(count, (float)worldX * oreScale + off.ox);
+                        sz.assign(count, (float)worldZ * oreScale + off.oz);
+                        sy.resize(count);
+                        for (int i = 0; i < count; i++) sy[i] = (float)(start + i) * oreScale + off.oy;
+                        perlin3Batch(sx.data(), sy.data(), sz.data(), veins[v].data() + start, (size_t)count);
+                        continue;
+                    }
 
-                else if (blockNoise(worldX, y, worldZ, 0.05f, 0.4f, andesiteOffset))
-                    chunk.setBlock(x, y, z, ANDESITE);
+                    // Bilinear in x/z for every layer, then linear in y
+                    int gx = x / ORE_CELL;
+                    int gz = z / ORE_CELL;
+                    float tx = (float)(x % ORE_CELL) / ORE_CELL;
+                    float tz = (float)(z % ORE_CELL) / ORE_CELL;
+                    columnLayers.resize(layers);
+                    for (int j = 0; j < layers; j++) {
+                        const float* layer = lattice[v].data() + (size_t)j * gw * gd;
+                        float a = lerpf(layer[gx + gw * gz], layer[gx + 1 + gw * gz], tx);
+                        float b = lerpf(layer[gx + gw * (gz + 1)], layer[gx + 1 + gw * (gz + 1)], tx);
+                        columnLayers[j] = lerpf(a, b, tz);
+                    }
+                    for (int y = start; y < c.stoneTop; y++) {
+                        int j = y / ORE_CELL - layer0;
+                        float ty = (float)(y % ORE_CELL) / ORE_CELL;
+                        veins[v][y] = lerpf(columnLayers[j], columnLayers[j + 1], ty);
+                    }
+                }
+            }
 
-                else if (blockNoise(worldX, y, worldZ, 0.05f, 0.4f, tuffOffset))
-                    chunk.setBlock(x, y, z, TUFF);
+            // Chunks start out as air, so nothing above the surface is written
+            for (int y = 0; y <= c.height; y++) {
+                BlockType type = STONE;
+                if (y == c.height) type = c.mountain ? COARSE_DIRT : GRASS;
+                else if (y >= c.stoneTop) type = DIRT;
+                else if (y >= start) {
+                    for (int v = 0; v < 4; v++) {
+                        if (veins[v][y] > oreMask) {
+                            type = veinTypes[v];
+                            break;
+                        }
+                    }
+                }
+                chunk.setBlock(x, y, z, type);
+            }
+        }
+    }
+    chunk.compact();
+}
 
-                else if (blockNoise(worldX, y, worldZ, 0.05f, 0.4f, dioriteOffset))
-                    chunk.setBlock(x, y, z, DIORITE);
-                
-                else
-                    chunk.setBlock(x, y, z, STONE);
+void buildLodMesh(int cx, int cz, int step, std::vector<PackedVertex>& out, MeshStats* outStats) {
+    // ManagedChunk dimensions
+    const int size = 16;
+    const int height = 128;
+    const int n = size / step;
+    const int pn = n + 2;
+
+    // Each cell samples the column at its centre; the ring around the chunk
+    // is sampled at the same step
+    std::vector<TerrainColumn> shape;
+    sampleTerrainColumns(cx * size - step + step / 2, cz * size - step + step / 2, pn, pn, step, height, shape);
+    auto cellAt = [&](int i, int j) -> const TerrainColumn& { return shape[(size_t)(i + 1) + pn * (j + 1)]; };
+
+    // Side faces in cubeFaces order: -Z, +Z, -X, +X
+    static const int dirs[4][2] = {{0, -1}, {0, 1}, {-1, 0}, {1, 0}};
+
+    out.clear();
+    MeshStats stats;
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            const TerrainColumn& c = cellAt(i, j);
+            const int x = i * step;
+            const int z = j * step;
+            Block surface;
+            surface.type = c.mountain ? COARSE_DIRT : GRASS;
+            ChunkMesh::appendFaceWithAtlas(out, 5, x, c.height, z, step, step, surface);
+            stats.quads++;
+
+            for (int f = 0; f < 4; f++) {
+                int ni = i + dirs[f][0];
+                int nj = j + dirs[f][1];
+                int lo = cellAt(ni, nj).height + 1;
+                if (ni < 0 || ni >= n || nj < 0 || nj >= n) lo = std::min(lo, c.height + 1) - step;
+                lo = std::max(lo, 0);
+                if (lo > c.height) continue;
+
+                // Faces on the positive side sit on the far edge of the cell
+                int bx = (f == 3) ? x + step - 1 : x;
+                int bz = (f == 1) ? z + step - 1 : z;
+                // Stone, then dirt, then the surface block, like the full terrain minus the veins
+                auto wall = [&](int y0, int y1, BlockType type) {
+                    y0 = std::max(y0, lo);
+                    if (y1 <= y0) return;
+                    Block b;
+                    b.type = type;
+                    ChunkMesh::appendFaceWithAtlas(out, f, bx, y0, bz, step, y1 - y0, b);
+                    stats.quads++;
+                };
+                wall(0, c.stoneTop, STONE);
+                wall(c.stoneTop, c.height, DIRT);
+                wall(c.height, c.height + 1, surface.type);
+            }
         }
+    }
+    if (!out.empty()) {
+        stats.minY = 255;
+        for (PackedVertex v : out) {
+            unsigned int y = (unsigned int)unpackVertexY(v);
+            stats.minY = std::min(stats.minY, y);
+            stats.maxY = std::max(stats.maxY, y);
         }
     }
+    if (outStats) *outStats = stats;
 }
 
-void generateTrees(Chunk& chunk, ChunkManager* manager) {
-    std::set<std::pair<int,int>> modifiedChunks;
+// Integer hash of a world column, used instead of rand() so trees don't
+// depend on which thread or in which order chunks were generated
+static uint32_t hashColumn(int x, int z, uint32_t salt) {
+    uint32_t h = (uint32_t)x * 0x8da6b343u ^ (uint32_t)z * 0xd8163841u ^ salt * 0xcb1ab31fu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
 
+void generateTrees(const Chunk& chunk, std::vector<StructureEdit>& out) {
     const int margin = 3;
 
+    auto place = [&](int bx, int by, int bz, BlockType type, bool onlyIntoAir) {
+        if (by < 0 || by >= (int)chunk.height) return;
+        StructureEdit e;
+        e.x = bx;
+        e.y = by;
+        e.z = bz;
+        e.block.type = type;
+        e.block.axis = LogAxis::Y;
+        e.onlyIntoAir = onlyIntoAir;
+        out.push_back(e);
+    };
+
     for (int x = margin; x < (int)chunk.width - margin; x++) {
         for (int z = margin; z < (int)chunk.depth - margin; z++) {
             int worldX = chunk.chunkX * chunk.width + x;
             int worldZ = chunk.chunkZ * chunk.depth + z;
 
-            BiomeType biome = getBiome(worldX, worldZ);
+            BiomeType biome = (BiomeType)chunk.biomes[x + chunk.width * z];
 
             float chance = (biome == FOREST) ? 0.08f : 0.005f;
-            if ((rand() % 1000) / 1000.0f > chance) continue;
+            if ((hashColumn(worldX, worldZ, 1) % 1000) / 1000.0f > chance) continue;
 
             int y;
             for (y = chunk.height - 1; y >= 0; y--) {
-                if (chunk.getBlock(x, y, z).type != AIR) break;
+                if (chunk.getType(x, y, z) != AIR) break;
             }
 
-            if (y <= 0 || chunk.getBlock(x, y, z).type != GRASS) continue;
+            if (y <= 0 || chunk.getType(x, y, z) != GRASS) continue;
 
-            int trunkHeight = 4 + rand() % 3;
+            int trunkHeight = 4 + hashColumn(worldX, worldZ, 2) % 3;
             int leafStart = y + trunkHeight - 2;
 
             int actualTrunkHeight = std::max(1, trunkHeight - 1);
             for (int ty = 1; ty <= actualTrunkHeight; ty++) {
                 if (y + ty >= (int)chunk.height) break;
-                setBlockWorld(manager, worldX, y + ty, worldZ, WOOD, LogAxis::Y, &modifiedChunks);
+                place(worldX, y + ty, worldZ, WOOD, false);
             }
 
             for (int lx = -2; lx <= 2; lx++) {
                 for (int lz = -2; lz <= 2; lz++) {
                     for (int ly = 0; ly <= 1; ly++) {
-                        int bx = worldX + lx;
-                        int bz = worldZ + lz;
-                        int by = leafStart + ly;
-                        if (by < 0 || by >= (int)chunk.height) continue;
-
-                        int cx = getChunkCoord((float)bx);
-                        int cz = getChunkCoord((float)bz);
-                        ManagedChunk* target = manager->getChunk(cx, cz);
-                        if (!target || !target->terrainGenerated) continue;
-
-                        int localX = bx - cx * (int)target->chunk.width;
-                        int localZ = bz - cz * (int)target->chunk.depth;
-                        BlockType current = target->chunk.getBlock(localX, by, localZ).type;
-                        if (current == AIR) {
-                            setBlockWorld(manager, bx, by, bz, LEAVES, LogAxis::Y, &modifiedChunks);
-                        }
+                        place(worldX + lx, leafStart + ly, worldZ + lz, LEAVES, true);
                     }
                 }
             }
@@ -529,144 +598,339 @@ void generateTrees(Chunk& chunk, ChunkManager* manager) {
             int baseTopperY = y + actualTrunkHeight + 1;
             for (int dy = 0; dy <= 1; ++dy) {
                 int by = baseTopperY + dy;
-                if (by < 0 || by >= (int)chunk.height) continue;
-
-                {
-                    int bx = worldX;
-                    int bz = worldZ;
-                    int cx = getChunkCoord((float)bx);
-                    int cz = getChunkCoord((float)bz);
-                    ManagedChunk* target = manager->getChunk(cx, cz);
-                    if (target && target->terrainGenerated) {
-                        int localX = bx - cx * (int)target->chunk.width;
-                        int localZ = bz - cz * (int)target->chunk.depth;
-                        BlockType current = target->chunk.getBlock(localX, by, localZ).type;
-                        if (current == AIR) {
-                            setBlockWorld(manager, bx, by, bz, LEAVES, LogAxis::Y, &modifiedChunks);
-                        }
-                    }
-                }
+                place(worldX, by, worldZ, LEAVES, true);
 
                 const int dirs[4][2] = {{1,0},{-1,0},{0,1},{0,-1}};
                 for (int i = 0; i < 4; ++i) {
-                    int bx = worldX + dirs[i][0];
-                    int bz = worldZ + dirs[i][1];
-                    int cx = getChunkCoord((float)bx);
-                    int cz = getChunkCoord((float)bz);
-                    ManagedChunk* target = manager->getChunk(cx, cz);
-                    if (!target || !target->terrainGenerated) continue;
-                    int localX = bx - cx * (int)target->chunk.width;
-                    int localZ = bz - cz * (int)target->chunk.depth;
-                    BlockType current = target->chunk.getBlock(localX, by, localZ).type;
-                    if (current == AIR) {
-                        setBlockWorld(manager, bx, by, bz, LEAVES, LogAxis::Y, &modifiedChunks);
-                    }
+                    place(worldX + dirs[i][0], by, worldZ + dirs[i][1], LEAVES, true);
                 }
             }
         }
     }
+}
 
-    for (auto &p : modifiedChunks) {
-        ManagedChunk* m = manager->getChunk(p.first, p.second);
-        if (m) {
-            m->meshDirty = true;
-            m->meshUploaded = false;
+// Main thread. Edits landing on a chunk edge also dirty the neighbour that
+// meshes against that edge.
+static void applyStructureEdits(ChunkManager& manager, const std::vector<StructureEdit>& edits) {
+    for (const StructureEdit& e : edits) {
+        int cx = getChunkCoord((float)e.x);
+        int cz = getChunkCoord((float)e.z);
+        ManagedChunk* target = manager.getChunk(cx, cz);
+        if (!target || !target->reached(ChunkState::Terrain)) continue;
+
+        int localX = e.x - cx * (int)target->chunk.width;
+        int localZ = e.z - cz * (int)target->chunk.depth;
+        if (e.onlyIntoAir && target->chunk.getType(localX, e.y, localZ) != AIR) continue;
+
+        setBlockWorld(&manager, e.x, e.y, e.z, e.block.type, e.block.axis);
+
+        int nx = 0, nz = 0;
+        if (localX == 0) nx = -1;
+        if (localX == (int)target->chunk.width - 1) nx = 1;
+        if (localZ == 0) nz = -1;
+        if (localZ == (int)target->chunk.depth - 1) nz = 1;
+        ManagedChunk* n = nullptr;
+        if (nx && (n = manager.getChunk(cx + nx, cz))) {
+            n->markBlockDirty(e.y);
+            manager.requestRemesh(n);
+        }
+        if (nz && (n = manager.getChunk(cx, cz + nz))) {
+            n->markBlockDirty(e.y);
+            manager.requestRemesh(n);
         }
     }
 }
 
-void updateChunks(ChunkManager& manager, glm::vec3 pos, int radius, unsigned int shader) {
-    while (true) {
-        CompletedTerrain t;
-        if (!g_completedTerrain.try_pop(t)) break;
-        ManagedChunk* mc = manager.getChunk(t.cx, t.cz);
-        if (mc) {
-            mc->inTerrainQueue = false;
-            mc->terrainGenerated = true;
-            mc->meshDirty = true;
+// True when the chunk and its 8 neighbours exist and have reached state
+static bool neighbourhoodReached(ChunkManager& manager, int cx, int cz, ChunkState state) {
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            ManagedChunk* n = manager.getChunk(cx + dx, cz + dz);
+            if (!n || !n->reached(state)) return false;
         }
     }
+    return true;
+}
 
-    int camChunkX = getChunkCoord(pos.x);
-    int camChunkZ = getChunkCoord(pos.z);
-
-    int pad = 1;
-    int fullRadius = radius + pad;
-
-    std::set<std::pair<int,int>> shouldExist;
-    for (int dx = -fullRadius; dx <= fullRadius; dx++) {
-        for (int dz = -fullRadius; dz <= fullRadius; dz++) {
-            int cx = camChunkX + dx;
-            int cz = camChunkZ + dz;
-            shouldExist.insert({cx, cz});
+bool neighbourhoodMeshed(ChunkManager& manager, int cx, int cz) {
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            ManagedChunk* n = manager.getChunk(cx + dx, cz + dz);
+            if (!n || !n->reached(ChunkState::Lit) || n->dirtySections || n->queuedSections) return false;
         }
     }
+    return true;
+}
+
+// Chunk offsets within radius, ring by ring from the centre and nearest
+// first within a ring
+static void buildSpiral(int radius, std::vector<std::pair<int,int>>& out) {
+    out.clear();
+    for (int dx = -radius; dx <= radius; dx++) {
+        for (int dz = -radius; dz <= radius; dz++) out.emplace_back(dx, dz);
+    }
+    std::sort(out.begin(), out.end(), [](const std::pair<int,int>& a, const std::pair<int,int>& b) {
+        int ra = std::max(std::abs(a.first), std::abs(a.second));
+        int rb = std::max(std::abs(b.first), std::abs(b.second));
+        if (ra != rb) return ra < rb;
+        return a.first * a.first + a.second * a.second < b.first * b.first + b.second * b.second;
+    });
+}
+
+// The camera's chunk can only mesh once its 3x3 neighbourhood is Lit, which
+// takes the 5x5 at Structures and the 7x7 at Terrain. Generation that close
+// is queued with the meshes rather than behind the rest of the ring, so the
+// ground under the player shows first (at spawn, after a teleport).
+static JobPriority generationPriority(const ChunkManager& manager, int cx, int cz, int nearRadius) {
+    bool near = manager.hasCenter && std::abs(cx - manager.centerX) <= nearRadius &&
+                std::abs(cz - manager.centerZ) <= nearRadius;
+    return near ? JobPriority::High : JobPriority::Low;
+}
+
+static void queueTerrain(ChunkManager& manager, ManagedChunk* mc) {
+    if (!mc->advance(ChunkState::New, ChunkState::TerrainQueued)) return;
+    int cx = mc->chunk.chunkX;
+    int cz = mc->chunk.chunkZ;
+    uint32_t id = mc->id;
+    RegionStore* regions = manager.regions;
+    getJobSystem().submit(generationPriority(manager, cx, cz, 3), [cx, cz, id, regions]() {
+        PROFILE_SCOPE("terrain job");
+        Chunk generated(cx, cz);
+        CompletedTerrain done;
+        // A chunk seen before only costs a decompress
+        done.fromDisk = regions && regions->load(generated, done.structuresDone);
+        if (!done.fromDisk) generateTerrainForChunk(generated);
+        done.cx = cx;
+        done.cz = cz;
+        done.chunkId = id;
+        done.sections = std::move(generated.sections);
+        done.heightmap = std::move(generated.heightmap);
+        done.biomes = std::move(generated.biomes);
+        g_completedTerrain.push(std::move(done));
+    }, mc->jobs);
+}
+
+// Unloads what left the square and creates what entered it, nearest first
+static void rebuildLoadSet(ChunkManager& manager, int camChunkX, int camChunkZ, int fullRadius) {
+    if (fullRadius != manager.loadedRadius) buildSpiral(fullRadius, manager.spiral);
+    manager.hasCenter = true;
+    manager.centerX = camChunkX;
+    manager.centerZ = camChunkZ;
+    manager.loadedRadius = fullRadius;
 
     std::vector<std::pair<int,int>> toRemove;
-    for (auto& pair : manager.chunks) {
-        if (shouldExist.find(pair.first) == shouldExist.end()) {
-            if (!pair.second->inTerrainQueue && !pair.second->inMeshQueue) {
-                toRemove.push_back(pair.first);
-            }
+    for (const ChunkMap::Slot& slot : manager.chunks) {
+        int cx = ChunkMap::keyX(slot.key);
+        int cz = ChunkMap::keyZ(slot.key);
+        if (std::abs(cx - camChunkX) > fullRadius || std::abs(cz - camChunkZ) > fullRadius) {
+            toRemove.emplace_back(cx, cz);
         }
     }
     for (auto& key : toRemove) {
         manager.removeChunk(key.first, key.second);
     }
 
-    std::vector<std::pair<int,int>> newlyCreated;
-    for (auto& p : shouldExist) {
-        int cx = p.first;
-        int cz = p.second;
-        if (!manager.getChunk(cx, cz)) {
-            ManagedChunk* mc = new ManagedChunk(cx, cz);
-            manager.addChunk(cx, cz, mc);
-            newlyCreated.emplace_back(cx, cz);
-        }
+    for (auto& offset : manager.spiral) {
+        int cx = camChunkX + offset.first;
+        int cz = camChunkZ + offset.second;
+        if (manager.getChunk(cx, cz)) continue;
+        ManagedChunk* mc = manager.acquireChunk(cx, cz);
+        manager.addChunk(cx, cz, mc);
+        queueTerrain(manager, mc);
     }
+}
 
-    // TERRAIN PASS
-    for (auto& pair : manager.chunks) {
-        ManagedChunk* mc = pair.second;
-        if (!mc->terrainGenerated && !mc->inTerrainQueue) {
-            mc->inTerrainQueue = true;
-            int cx = mc->chunk.chunkX;
-            int cz = mc->chunk.chunkZ;
-
-            getThreadPool().enqueue([mc, cx, cz]() {
-                generateTerrainForChunk(mc->chunk);
-                g_completedTerrain.push({cx, cz});
-            });
+static void queueStructures(ChunkManager& manager, ManagedChunk* mc) {
+    int cx = mc->chunk.chunkX;
+    int cz = mc->chunk.chunkZ;
+    uint32_t id = mc->id;
+    getJobSystem().submit(generationPriority(manager, cx, cz, 2), [mc, cx, cz, id]() {
+        PROFILE_SCOPE("structures job");
+        CompletedStructures done;
+        done.cx = cx;
+        done.cz = cz;
+        done.chunkId = id;
+        {
+            std::shared_lock<std::shared_mutex> lock(mc->chunk.lock);
+            generateTrees(mc->chunk, done.edits);
         }
-    }
+        g_completedStructures.push(std::move(done));
+    }, mc->jobs);
+}
+
+static const int MAX_MESH_CAPTURES_PER_FRAME = 128;
+
+static void queueMesh(ChunkManager& manager, ManagedChunk* mc, int section) {
+    int cx = mc->chunk.chunkX;
+    int cz = mc->chunk.chunkZ;
+    uint32_t id = mc->id;
+    uint32_t generation = mc->generations[section];
+    // Sections that are already on screen go ahead of first-time meshes
+    JobPriority priority = mc->meshes[section].vertexCount() > 0 ? JobPriority::Urgent : JobPriority::High;
+    std::unique_ptr<MeshInput> input(new MeshInput());
+    input->capture(mc->chunk, manager, section, g_meshingMode.load(std::memory_order_relaxed));
+    // The job only reads its input; the token lets unloading cancel it
+    getJobSystem().submit(priority, [input = std::move(input), cx, cz, id, section, generation, &manager]() {
+        PROFILE_SCOPE("mesh job");
+        // Scratch is reused per worker; the only copy is into the mapped staging ring
+        thread_local std::vector<PackedVertex> scratch;
+        CompletedMesh done;
+        done.cx = cx;
+        done.cz = cz;
+        done.chunkId = id;
+        done.section = section;
+        done.generation = generation;
+        // Air sections mesh in no time; a record would only cost a sector
+        bool useCache = !input->empty && g_meshCacheEnabled.load(std::memory_order_relaxed);
+        RegionStore* cache = useCache ? manager.regions : nullptr;
+        uint64_t key = cache ? ChunkMesh::cacheKey(*input) : 0;
+        bool cached = cache && cache->loadMesh(cx, cz, section, key, scratch, done.stats);
+        if (cached) {
+            g_meshCacheHits.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            ChunkMesh::buildVertices(*input, scratch, &done.stats);
+            if (cache) {
+                if (!scratch.empty()) cache->saveMesh(cx, cz, section, key, scratch, done.stats);
+                g_meshCacheMisses.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        done.vertexCount = (unsigned int)scratch.size();
+        MeshStagingFn stage = g_meshStaging.load();
+        if (!stage || !stage(scratch.data(), scratch.size() * sizeof(PackedVertex), done.staging)) {
+            done.vertices = scratch;
+        }
+        g_completedMeshes.push(std::move(done));
+    }, mc->jobs);
+}
 
-    for (auto& pair : manager.chunks) {
-        ManagedChunk* mc = pair.second;
-        if (mc->terrainGenerated && !mc->structuresGenerated && !mc->inStructQueue) {
-            generateTrees(mc->chunk, &manager);
-            mc->structuresGenerated = true;
-            mc->meshDirty = true;
+// Steady state (no boundary crossing, no finished jobs, no edits) touches no
+// chunk at all
+void updateChunks(ChunkManager& manager, glm::vec3 pos, int radius, unsigned int shader) {
+    PROFILE_SCOPE("updateChunks");
+    static std::vector<CompletedTerrain> terrainBatch;
+    terrainBatch.clear();
+    g_completedTerrain.popBatch(terrainBatch);
+    for (CompletedTerrain& t : terrainBatch) {
+        ManagedChunk* mc = manager.getChunk(t.cx, t.cz);
+        if (mc && mc->id == t.chunkId) {
+            {
+                std::unique_lock<std::shared_mutex> lock(mc->chunk.lock);
+                mc->chunk.sections = std::move(t.sections);
+                mc->chunk.heightmap = std::move(t.heightmap);
+                mc->chunk.biomes = std::move(t.biomes);
+            }
+            if (t.fromDisk && t.structuresDone) {
+                // Its trees are already in the blocks
+                mc->advance(ChunkState::TerrainQueued, ChunkState::Structures);
+                manager.addNeighbourhood(manager.lightChecks, t.cx, t.cz);
+            } else {
+                mc->advance(ChunkState::TerrainQueued, ChunkState::Terrain);
+            }
+            mc->unsaved = !t.fromDisk;
+            mc->markAllDirty();
+            manager.addNeighbourhood(manager.structureChecks, t.cx, t.cz);
         }
     }
 
-    // MESH PASS
-    for (auto& p : shouldExist) {
-        auto mc = manager.getChunk(p.first, p.second);
+    static std::vector<CompletedStructures> structureBatch;
+    structureBatch.clear();
+    g_completedStructures.popBatch(structureBatch);
+    for (CompletedStructures& r : structureBatch) {
+        ManagedChunk* mc = manager.getChunk(r.cx, r.cz);
+        if (!mc || mc->id != r.chunkId) continue;
+        applyStructureEdits(manager, r.edits);
+        mc->advance(ChunkState::StructuresQueued, ChunkState::Structures);
+        manager.addNeighbourhood(manager.lightChecks, r.cx, r.cz);
+    }
+
+    int camChunkX = getChunkCoord(pos.x);
+    int camChunkZ = getChunkCoord(pos.z);
+
+    // Structures wait for their 3x3 neighbourhood's terrain and meshing for
+    // its structures, so two rings beyond the render distance are loaded
+    int pad = 2;
+    int fullRadius = radius + pad;
+
+    if (!manager.hasCenter || camChunkX != manager.centerX || camChunkZ != manager.centerZ ||
+        fullRadius != manager.loadedRadius) {
+        rebuildLoadSet(manager, camChunkX, camChunkZ, fullRadius);
+    }
+    manager.freeRetired();
+
+    // STRUCTURE PASS: planned on a worker, applied when the result comes back.
+    // Checked when the chunk or a neighbour gets its terrain.
+    static std::vector<ChunkRef> work;
+    work.swap(manager.structureChecks);
+    for (const ChunkRef& ref : work) {
+        ManagedChunk* mc = manager.resolve(ref);
+        if (!mc || mc->state.load() != ChunkState::Terrain) continue;
+        if (!neighbourhoodReached(manager, ref.cx, ref.cz, ChunkState::Terrain)) continue;
+        if (mc->advance(ChunkState::Terrain, ChunkState::StructuresQueued)) queueStructures(manager, mc);
+    }
+    work.clear();
+
+    // LIGHT PASS: there is no light data yet, so this only waits for the
+    // neighbourhood's structures to be final before the chunk may mesh.
+    // Checked when the chunk or a neighbour gets its structures.
+    work.swap(manager.lightChecks);
+    for (const ChunkRef& ref : work) {
+        ManagedChunk* mc = manager.resolve(ref);
+        if (!mc || mc->state.load() != ChunkState::Structures) continue;
+        if (!neighbourhoodReached(manager, ref.cx, ref.cz, ChunkState::Structures)) continue;
+        if (mc->advance(ChunkState::Structures, ChunkState::Lit)) manager.requestRemesh(mc);
+    }
+    work.clear();
+
+    // MESH PASS. Chunks that can't make progress yet leave the list; becoming
+    // Lit, a new edit or a returning mesh job puts them back. Capturing a
+    // section's input costs main-thread time, so a burst such as a whole row
+    // of chunks turning Lit is spread over a few frames.
+    int captures = 0;
+    work.swap(manager.remeshList);
+    for (const ChunkRef& ref : work) {
+        ManagedChunk* mc = manager.resolve(ref);
         if (!mc) continue;
+        mc->inRemeshList = false;
+        if (!mc->reached(ChunkState::Lit)) {
+            mc->urgentSections = 0;
+            continue;
+        }
+
+        // Edits are rebuilt here on the main thread instead of waiting behind
+        // queued jobs; this is the only writer, so it can read the blocks
+        // directly. All edits of a frame to one section share a single rebuild.
+        if (mc->urgentSections) {
+            static std::vector<PackedVertex> editScratch;
+            for (int section = 0; section < mc->chunk.sectionCount(); section++) {
+                uint32_t bit = 1u << section;
+                if (!(mc->urgentSections & bit)) continue;
+                ChunkMesh& mesh = mc->meshes[section];
+                ChunkMesh::buildVertices(mc->chunk, &manager, section, editScratch, &mesh.stats);
+                mesh.uploadToGPU(editScratch);
+                // A job still in flight for this section has an older generation
+                // and is dropped when it completes
+                mc->dirtySections &= ~bit;
+            }
+            mc->urgentSections = 0;
+        }
+
+        uint32_t pending = mc->dirtySections & ~mc->queuedSections;
+        for (int section = 0; pending; section++, pending >>= 1) {
+            if (!(pending & 1u)) continue;
+            if (captures == MAX_MESH_CAPTURES_PER_FRAME) {
+                manager.requestRemesh(mc);
+                break;
+            }
+            uint32_t bit = 1u << section;
+            mc->dirtySections &= ~bit;
+
+            // Empty sections that never had geometry need no job
+            if (mc->chunk.sectionEmpty(section) && mc->meshes[section].vertexCount() == 0) continue;
 
-        if (!mc->terrainGenerated) continue;
-        if (!mc->structuresGenerated) continue;
-
-        if ((!mc->meshUploaded || mc->meshDirty) && !mc->inMeshQueue) {
-            mc->inMeshQueue = true;
-            int cx = p.first;
-            int cz = p.second;
-            getThreadPool().enqueue([cx, cz, &manager]() {
-                auto m = manager.getChunk(cx, cz);
-                if (!m) return;
-                auto verts = ChunkMesh::buildVertices(m->chunk, &manager);
-                g_completedMeshes.push({cx, cz, std::move(verts)});
-            });
+            mc->queuedSections |= bit;
+            queueMesh(manager, mc, section);
+            captures++;
         }
     }
+    work.clear();
 }
\ No newline at end of file
@@ -1,65 +1,180 @@
 #pragma once
 #include "chunk.h"
-#include <unordered_map>
+#include "chunk_map.h"
+#include "mpsc_queue.h"
+#include "noise.h"
+#include "region_file.h"
 #include <set>
 #include <vector>
 #include <queue>
 #include <mutex>
 #include <glm/glm.hpp>
 
-struct pair_hash {
-    template <class T1, class T2>
-    std::size_t operator () (const std::pair<T1,T2> &p) const {
-        auto h1 = std::hash<T1>{}(p.first);
-        auto h2 = std::hash<T2>{}(p.second);
-        return h1 ^ (h2 << 1);
-    }
-};
-
 enum BiomeType {
     PLAINS = 0,
     FOREST,
     MOUNTAIN
 };
 
+// Names one load of a chunk; stays safe to hold after the chunk is unloaded
+struct ChunkRef {
+    int cx;
+    int cz;
+    uint32_t id;
+};
+
 struct ChunkManager {
-    std::unordered_map<std::pair<int,int>, ManagedChunk*, pair_hash> chunks;
+    ChunkMap chunks;
 
-    ManagedChunk* getChunk(int cx, int cz);
-    void addChunk(int cx, int cz, ManagedChunk* chunk);
+    // Unloaded chunks whose jobs may still be running
+    std::vector<ManagedChunk*> retired;
+    // Idle chunks kept for reuse instead of being freed; at most poolCap,
+    // so this bounds what stays allocated after the view moves on
+    std::vector<ManagedChunk*> pool;
+    size_t poolCap = 256;
+    uint32_t nextChunkId = 1;
+
+    // The load set is only rebuilt when the camera enters another chunk or
+    // the radius changes
+    bool hasCenter = false;
+    int centerX = 0;
+    int centerZ = 0;
+    int loadedRadius = -1;
+    std::vector<std::pair<int,int>> spiral; // offsets within loadedRadius, nearest first
+
+    // Per-stage work lists, filled when chunks change state instead of
+    // scanning every chunk each frame
+    std::vector<ChunkRef> structureChecks; // may be ready for structures
+    std::vector<ChunkRef> lightChecks;     // may be ready for the light stage
+    std::vector<ChunkRef> remeshList;      // has dirty or urgent sections
+
+    // Called per block near chunk edges, so kept inline
+    ManagedChunk* getChunk(int cx, int cz) { return chunks.find(cx, cz); }
+    void addChunk(int cx, int cz, ManagedChunk* chunk); // assigns chunk->id
+    // A pooled chunk reset to (cx, cz), or a new one; pass it to addChunk
+    ManagedChunk* acquireChunk(int cx, int cz);
+    // Saves the chunk if it changed since it was loaded, cancels its queued
+    // jobs and retires it; freeRetired() pools or deletes it once none of its
+    // jobs is running
     void removeChunk(int cx, int cz);
+    void freeRetired();
     std::vector<ManagedChunk*> getNeighbors4(int cx, int cz);
 
+    // Chunks are saved here when they unload, optional
+    RegionStore* regions = nullptr;
+    // Queues a write if the chunk has changes that aren't on disk yet
+    void save(ManagedChunk* mc);
+    void saveAll();
+
+    // nullptr if that load of the chunk is gone
+    ManagedChunk* resolve(const ChunkRef& ref);
+    // Call after marking sections dirty or urgent
+    void requestRemesh(ManagedChunk* mc);
+    // Adds the 3x3 neighbourhood around (cx, cz) to a work list
+    void addNeighbourhood(std::vector<ChunkRef>& list, int cx, int cz);
+
+    // Cancels the jobs of every chunk, loaded or retired, and waits until
+    // none of them is running. For teardown: queued stages never finish
+    // afterwards. The destructor does this too.
+    void cancelJobs();
+
     ~ChunkManager();
 };
 
+// Mesh jobs hand their vertices to this when it is set; the game points it at
+// g_stagingRing. Without it, or when it fails, they go in
+// CompletedMesh::vertices. Keeps the world code free of GL. Jobs read it
+// while they run, so clear it only once the job system is shut down.
+using MeshStagingFn = bool (*)(const void* data, size_t bytes, StagingSlice& out);
+extern std::atomic<MeshStagingFn> g_meshStaging;
+
+// Normally the vertices sit in g_stagingRing; the vector is only filled when
+// the ring is full or persistent mapping is unavailable.
 struct CompletedMesh {
     int cx;
     int cz;
-    std::vector<float> vertices;
+    uint32_t chunkId = 0;
+    int section = 0;
+    uint32_t generation = 0; // ManagedChunk::generations[section] when the job was queued
+    StagingSlice staging;
+    unsigned int vertexCount = 0;
+    std::vector<PackedVertex> vertices;
+    MeshStats stats;
+};
+
+// Terrain is generated into a private chunk and its sections are installed
+// on the main thread, the only thread that writes block data.
+struct CompletedTerrain {
+    int cx = 0;
+    int cz = 0;
+    uint32_t chunkId = 0;
+    std::vector<PalettedSection> sections;
+    std::vector<uint8_t> heightmap;
+    std::vector<uint8_t> biomes;
+    bool fromDisk = false;       // loaded instead of generated
+    bool structuresDone = false; // saved after its structure stage ran
 };
-class CompletedMeshQueue {
-public:
-    void push(CompletedMesh m);
-    bool try_pop(CompletedMesh& out);
-private:
-    std::mutex mtx;
-    std::queue<CompletedMesh> q;
+
+// One block written by a structure, in world coordinates
+struct StructureEdit {
+    int x, y, z;
+    Block block;
+    bool onlyIntoAir; // leaves don't replace what is already there
 };
-class ThreadPool;
-ThreadPool& getThreadPool();
+
+// Structures are planned by a worker from the chunk's own terrain; the main
+// thread applies the edits, which may reach into the 3x3 neighbourhood.
+struct CompletedStructures {
+    int cx = 0;
+    int cz = 0;
+    uint32_t chunkId = 0;
+    std::vector<StructureEdit> edits;
+};
+
+// Workers push, the main thread drains once per frame
+using CompletedMeshQueue = MpscQueue<CompletedMesh>;
+using CompletedTerrainQueue = MpscQueue<CompletedTerrain>;
+using CompletedStructuresQueue = MpscQueue<CompletedStructures>;
 extern CompletedMeshQueue g_completedMeshes;
+extern CompletedTerrainQueue g_completedTerrain;
+extern CompletedStructuresQueue g_completedStructures;
+
+// How generateTerrainForChunk samples the stone veins. Terrain jobs read
+// these when they start, so a change applies to chunks generated after it.
+// Both default to what every seed has always generated; Coarse moves veins
+// (saved chunks keep the old ones, so seams show at their borders).
+enum class OreNoiseMode {
+    Exact = 0, // perlin3 per voxel
+    Coarse     // every 4 blocks, trilinearly interpolated in between
+};
+extern std::atomic<OreNoiseMode> g_oreNoiseMode;
+// Leaves stone that no face of air can reach without veins
+extern std::atomic<bool> g_skipHiddenOres;
+
+// Mesh jobs reuse the vertices cached next to the region files when the
+// section's cacheKey matches, and store what they build otherwise
+extern std::atomic<bool> g_meshCacheEnabled;
+extern std::atomic<unsigned int> g_meshCacheHits;
+extern std::atomic<unsigned int> g_meshCacheMisses;
 
 // Terrain generation
-void initPerlin(unsigned int seed = 0);
-float perlin(float x, float y);
 float getTerrainHeight(int worldX, int worldZ);
 BiomeType getBiome(int worldX, int worldZ);
 void generateTerrainForChunk(Chunk& chunk);
-void generateTrees(Chunk& chunk, ChunkManager* manager);
+// Far terrain: a heightmap mesh of chunk (cx, cz) with one column per step x
+// step blocks, sampled straight from the terrain noise without any block
+// storage. Walls on the chunk border reach at least one step below both
+// sides, a skirt that hides cracks against neighbours of another step.
+void buildLodMesh(int cx, int cz, int step, std::vector<PackedVertex>& out, MeshStats* outStats = nullptr);
+// Appends the tree edits for chunk; deterministic per world position.
+// Reads only chunk itself, including the biomes terrain generation cached.
+void generateTrees(const Chunk& chunk, std::vector<StructureEdit>& out);
 
 // World utilities
 int getChunkCoord(float worldPos);
 void setBlockWorld(ChunkManager* manager, int worldX, int y, int worldZ, BlockType type,
                    LogAxis axis = LogAxis::Y, std::set<std::pair<int,int>>* modified = nullptr);
-void updateChunks(ChunkManager& manager, glm::vec3 pos, int radius, unsigned int shader);
\ No newline at end of file
+void updateChunks(ChunkManager& manager, glm::vec3 pos, int radius, unsigned int shader);
+// True once the 3x3 around chunk (cx, cz) is Lit with every section's mesh
+// current: the ground around the player is on screen
+bool neighbourhoodMeshed(ChunkManager& manager, int cx, int cz);
\ No newline at end of file
@@ -0,0 +1,332 @@
+#include "world_buffer.h"
+#include <iostream>
+#include <iterator>
+#include <cstring>
+
+WorldBuffer g_worldBuffer;
+StagingRing g_stagingRing;
+
+// Allocations are rounded up so small remeshes can reuse their slot
+static const unsigned int ALLOC_GRANULARITY = 64;
+
+static unsigned int roundUp(unsigned int count) {
+    return (count + ALLOC_GRANULARITY - 1) / ALLOC_GRANULARITY * ALLOC_GRANULARITY;
+}
+
+bool WorldBuffer::initialize(unsigned int initialVertices) {
+    multiDrawIndirect = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &originBuffer);
+    glGenBuffers(1, &indirectBuffer);
+
+    capacityVertices = roundUp(initialVertices);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)capacityVertices * sizeof(PackedVertex), nullptr, GL_DYNAMIC_DRAW);
+    freeRanges.clear();
+    freeRanges[0] = capacityVertices;
+    usedVertices = 0;
+
+    GLuint indexBuffer = ensureQuadIndexBuffer(0);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    bindVertexFormat();
+    glBindVertexArray(0);
+
+    std::cout << "World buffer: " << (capacityBytes() >> 20) << " MiB, "
+              << (multiDrawIndirect ? "multi-draw indirect" : "per-chunk draws") << std::endl;
+    return vao != 0 && vbo != 0;
+}
+
+void WorldBuffer::shutdown() {
+    if (indirectBuffer) glDeleteBuffers(1, &indirectBuffer);
+    if (originBuffer) glDeleteBuffers(1, &originBuffer);
+    if (vbo) glDeleteBuffers(1, &vbo);
+    if (vao) glDeleteVertexArrays(1, &vao);
+    indirectBuffer = originBuffer = vbo = vao = 0;
+}
+
+void WorldBuffer::bindVertexFormat() {
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(PackedVertex), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    if (multiDrawIndirect) {
+        glBindBuffer(GL_ARRAY_BUFFER, originBuffer);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glVertexAttribDivisor(1, 1);
+        glEnableVertexAttribArray(1);
+    } else {
+        // Fed per draw through glVertexAttrib3f
+        glDisableVertexAttribArray(1);
+    }
+}
+
+bool WorldBuffer::allocate(unsigned int count, MeshAllocation& out) {
+    unsigned int size = roundUp(count);
+    for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+        if (it->second < size) continue;
+
+        unsigned int offset = it->first;
+        unsigned int remaining = it->second - size;
+        freeRanges.erase(it);
+        if (remaining > 0) freeRanges[offset + size] = remaining;
+
+        out.offset = offset;
+        out.capacity = size;
+        usedVertices += size;
+        return true;
+    }
+    return false;
+}
+
+void WorldBuffer::release(MeshAllocation& alloc) {
+    if (!alloc.valid()) return;
+
+    unsigned int offset = alloc.offset;
+    unsigned int size = alloc.capacity;
+    usedVertices -= size;
+    alloc = MeshAllocation();
+
+    // Coalesce with the neighbouring free ranges
+    auto next = freeRanges.lower_bound(offset);
+    if (next != freeRanges.end() && offset + size == next->first) {
+        size += next->second;
+        next = freeRanges.erase(next);
+    }
+    if (next != freeRanges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += size;
+            return;
+        }
+    }
+    freeRanges[offset] = size;
+}
+
+void WorldBuffer::grow(unsigned int minVertices) {
+    unsigned int newCapacity = capacityVertices;
+    while (newCapacity < minVertices) newCapacity *= 2;
+
+    GLuint newVbo = 0;
+    glGenBuffers(1, &newVbo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newVbo);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)newCapacity * sizeof(PackedVertex), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, vbo);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                        (GLsizeiptr)capacityVertices * sizeof(PackedVertex));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &vbo);
+    vbo = newVbo;
+
+    // Hand the new tail to the free list, merging with a free range at the old end
+    MeshAllocation tail;
+    tail.offset = capacityVertices;
+    tail.capacity = newCapacity - capacityVertices;
+    usedVertices += tail.capacity;
+    capacityVertices = newCapacity;
+    release(tail);
+
+    glBindVertexArray(vao);
+    bindVertexFormat();
+    glBindVertexArray(0);
+
+    std::cout << "World buffer grown to " << (capacityBytes() >> 20) << " MiB" << std::endl;
+}
+
+bool WorldBuffer::reserve(MeshAllocation& alloc, unsigned int count) {
+    if (count == 0) {
+        release(alloc);
+        return false;
+    }
+    if (alloc.valid() && alloc.capacity < count) release(alloc);
+
+    if (!alloc.valid() && !allocate(count, alloc)) {
+        grow(capacityVertices + roundUp(count));
+        allocate(count, alloc);
+    }
+    alloc.count = count;
+
+    size_t quads = count / VERTICES_PER_QUAD;
+    if (quads > maxQuads) {
+        maxQuads = quads;
+        ensureQuadIndexBuffer(quads);
+    }
+    return true;
+}
+
+void WorldBuffer::upload(MeshAllocation& alloc, const PackedVertex* vertices, unsigned int count) {
+    if (!reserve(alloc, count)) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)alloc.offset * sizeof(PackedVertex),
+                    (GLsizeiptr)count * sizeof(PackedVertex), vertices);
+}
+
+void WorldBuffer::copyFromStaging(MeshAllocation& alloc, GLuint srcBuffer, size_t srcOffset, unsigned int count) {
+    if (!reserve(alloc, count)) return;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, srcBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)srcOffset,
+                        (GLintptr)alloc.offset * sizeof(PackedVertex), (GLsizeiptr)count * sizeof(PackedVertex));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void WorldBuffer::beginFrame() {
+    commands.clear();
+    origins.clear();
+}
+
+void WorldBuffer::addDraw(const MeshAllocation& alloc, const glm::vec3& origin) {
+    if (!alloc.valid() || alloc.count == 0) return;
+
+    DrawElementsIndirectCommand cmd;
+    cmd.count = (alloc.count / VERTICES_PER_QUAD) * INDICES_PER_QUAD;
+    cmd.instanceCount = 1;
+    cmd.firstIndex = 0;
+    cmd.baseVertex = (GLint)alloc.offset;
+    cmd.baseInstance = (GLuint)commands.size();
+    commands.push_back(cmd);
+
+    origins.push_back(origin.x);
+    origins.push_back(origin.y);
+    origins.push_back(origin.z);
+}
+
+void WorldBuffer::submit() {
+    if (commands.empty()) return;
+
+    glBindVertexArray(vao);
+    if (multiDrawIndirect) {
+        // Orphan and refill every frame, the visible set changes constantly
+        glBindBuffer(GL_ARRAY_BUFFER, originBuffer);
+        glBufferData(GL_ARRAY_BUFFER, origins.size() * sizeof(float), origins.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand),
+                     commands.data(), GL_STREAM_DRAW);
+
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, (GLsizei)commands.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    } else {
+        for (size_t i = 0; i < commands.size(); i++) {
+            glVertexAttrib3f(1, origins[i * 3 + 0], origins[i * 3 + 1], origins[i * 3 + 2]);
+            glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)commands[i].count, GL_UNSIGNED_INT,
+                                     (void*)0, commands[i].baseVertex);
+        }
+    }
+    glBindVertexArray(0);
+}
+
+bool StagingRing::initialize(size_t bytes) {
+    if (!(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)) {
+        std::cout << "Staging ring: persistent mapping unavailable, uploading from CPU copies" << std::endl;
+        return false;
+    }
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &buf);
+    glBindBuffer(GL_COPY_READ_BUFFER, buf);
+    glBufferStorage(GL_COPY_READ_BUFFER, (GLsizeiptr)bytes, nullptr, flags);
+    mapped = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, (GLsizeiptr)bytes, flags);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    if (!mapped) {
+        glDeleteBuffers(1, &buf);
+        buf = 0;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    capacity = bytes;
+    head = 0;
+    segments.clear();
+    return true;
+}
+
+void StagingRing::shutdown() {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto& seg : segments) {
+        if (seg.fence) glDeleteSync(seg.fence);
+    }
+    segments.clear();
+    if (buf) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buf);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteBuffers(1, &buf);
+    }
+    buf = 0;
+    mapped = nullptr;
+    capacity = 0;
+}
+
+bool StagingRing::write(const void* data, size_t bytes, StagingSlice& out) {
+    if (bytes == 0) return false;
+
+    size_t offset;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!mapped || bytes > capacity) return false;
+
+        if (segments.empty()) head = 0;
+        size_t tail = segments.empty() ? 0 : segments.front().offset;
+        bool wrapped = !segments.empty() && head <= tail;
+
+        if (wrapped) {
+            if (tail - head < bytes) return false;
+        } else if (capacity - head < bytes) {
+            if (tail < bytes) return false;
+            // Pad out the end so the slice starts at 0
+            if (head < capacity) segments.push_back({head, capacity - head, true, nullptr});
+            head = 0;
+        }
+
+        offset = head;
+        head += bytes;
+        segments.push_back({offset, bytes, false, nullptr});
+    }
+
+    // The slice is ours until release(), so copy without holding the lock
+    std::memcpy(mapped + offset, data, bytes);
+    out.offset = offset;
+    out.size = bytes;
+    return true;
+}
+
+void StagingRing::release(const StagingSlice& slice) {
+    if (!slice.valid()) return;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto& seg : segments) {
+        if (seg.offset == slice.offset && !seg.released) {
+            seg.released = true;
+            seg.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            break;
+        }
+    }
+}
+
+void StagingRing::reclaim() {
+    std::lock_guard<std::mutex> lock(mtx);
+    while (!segments.empty()) {
+        Segment& seg = segments.front();
+        if (!seg.released) break;
+        if (seg.fence) {
+            GLenum status = glClientWaitSync(seg.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+            glDeleteSync(seg.fence);
+        }
+        segments.pop_front();
+    }
+}
+
+size_t StagingRing::bytesInUse() {
+    std::lock_guard<std::mutex> lock(mtx);
+    size_t total = 0;
+    for (auto& seg : segments) total += seg.size;
+    return total;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <map>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include "chunk.h"
+
+// Returns the shared quad index buffer, grown to cover at least quadCount
+// quads. The buffer name never changes, so VAOs bound to it stay valid. Only
+// depends on VERTICES_PER_QUAD, not on the vertex layout. GL thread only.
+GLuint ensureQuadIndexBuffer(size_t quadCount);
+
+// All chunk meshes live in one vertex buffer, sub-allocated with a first-fit
+// free list. The visible set is gathered each frame and submitted with a
+// single glMultiDrawElementsIndirect, the per-draw chunk origin comes from an
+// instanced attribute indexed through baseInstance. Without GL 4.3 the same
+// buffer is drawn with one glDrawElementsBaseVertex per chunk.
+class WorldBuffer {
+public:
+    bool initialize(unsigned int initialVertices = 1u << 22);
+    void shutdown();
+
+    // Reserves space for count vertices and uploads them. Reuses the old
+    // allocation when it is large enough. Grows the buffer when full.
+    void upload(MeshAllocation& alloc, const PackedVertex* vertices, unsigned int count);
+    // Same, but the vertices are copied GPU-side from another buffer
+    void copyFromStaging(MeshAllocation& alloc, GLuint srcBuffer, size_t srcOffset, unsigned int count);
+    void release(MeshAllocation& alloc); // CPU side only, safe without a context
+
+    void beginFrame();
+    void addDraw(const MeshAllocation& alloc, const glm::vec3& origin);
+    void submit();
+
+    bool usesMultiDrawIndirect() const { return multiDrawIndirect; }
+    unsigned int drawCount() const { return (unsigned int)origins.size() / 3; }
+    size_t usedBytes() const { return (size_t)usedVertices * sizeof(PackedVertex); }
+    size_t capacityBytes() const { return (size_t)capacityVertices * sizeof(PackedVertex); }
+
+private:
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    bool allocate(unsigned int count, MeshAllocation& out);
+    bool reserve(MeshAllocation& alloc, unsigned int count);
+    void grow(unsigned int minVertices);
+    void bindVertexFormat();
+
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint originBuffer = 0;
+    GLuint indirectBuffer = 0;
+    bool multiDrawIndirect = false;
+
+    unsigned int capacityVertices = 0;
+    unsigned int usedVertices = 0;
+    size_t maxQuads = 0;
+    std::map<unsigned int, unsigned int> freeRanges; // offset -> size
+
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<float> origins;
+};
+
+// Persistently mapped upload ring (GL 4.4 / ARB_buffer_storage). Mesh
+// workers write finished vertices straight into it, the GL thread only
+// copies slices into the world buffer and fences them before they are
+// reused. Space is handed out in order and reclaimed in order once the
+// fence of every older slice has signalled.
+class StagingRing {
+public:
+    bool initialize(size_t bytes); // false when persistent mapping is unsupported
+    // Unmaps the ring; no write() may still be running, see g_meshStaging
+    void shutdown();
+
+    // Any thread. Fails when the ring is full or not initialized.
+    bool write(const void* data, size_t bytes, StagingSlice& out);
+
+    // GL thread, after the copy out of the slice has been issued
+    void release(const StagingSlice& slice);
+    void reclaim();
+
+    GLuint buffer() const { return buf; }
+    size_t bytesInUse();
+
+private:
+    struct Segment {
+        size_t offset;
+        size_t size;
+        bool released;
+        GLsync fence;
+    };
+
+    std::mutex mtx;
+    GLuint buf = 0;
+    unsigned char* mapped = nullptr;
+    size_t capacity = 0;
+    size_t head = 0;
+    std::deque<Segment> segments; // in reservation order
+};
+
+extern WorldBuffer g_worldBuffer;
+extern StagingRing g_stagingRing;
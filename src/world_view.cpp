@@ -0,0 +1,107 @@
+#include "world_view.h"
+#include <algorithm>
+#include <cmath>
+
+// log2 of the chunk width getChunkCoord divides by
+static const int CHUNK_SHIFT = 4;
+
+ManagedChunk* WorldView::chunkAt(int cx, int cz) {
+    if (cx != cachedX || cz != cachedZ) {
+        cached = manager.getChunk(cx, cz);
+        cachedX = cx;
+        cachedZ = cz;
+    }
+    return cached;
+}
+
+BlockType WorldView::getType(int x, int y, int z) {
+    int cx = x >> CHUNK_SHIFT;
+    int cz = z >> CHUNK_SHIFT;
+    ManagedChunk* mc = chunkAt(cx, cz);
+    if (!mc) return AIR;
+    const Chunk& chunk = mc->chunk;
+    int localX = x - (cx << CHUNK_SHIFT);
+    int localZ = z - (cz << CHUNK_SHIFT);
+    if (localX >= (int)chunk.width || localZ >= (int)chunk.depth || y < 0 || y >= (int)chunk.height) return AIR;
+    return chunk.getType(localX, y, localZ);
+}
+
+bool WorldView::anySolid(const glm::vec3& min, const glm::vec3& max) {
+    int x0 = (int)std::floor(min.x), x1 = (int)std::floor(max.x);
+    int y0 = (int)std::floor(min.y), y1 = (int)std::floor(max.y);
+    int z0 = (int)std::floor(min.z), z1 = (int)std::floor(max.z);
+
+    for (int cx = x0 >> CHUNK_SHIFT; cx <= x1 >> CHUNK_SHIFT; cx++) {
+        for (int cz = z0 >> CHUNK_SHIFT; cz <= z1 >> CHUNK_SHIFT; cz++) {
+            ManagedChunk* mc = chunkAt(cx, cz);
+            if (!mc) continue;
+            const Chunk& chunk = mc->chunk;
+            int baseX = cx << CHUNK_SHIFT;
+            int baseZ = cz << CHUNK_SHIFT;
+            int lx0 = std::max(x0 - baseX, 0), lx1 = std::min(x1 - baseX, (int)chunk.width - 1);
+            int lz0 = std::max(z0 - baseZ, 0), lz1 = std::min(z1 - baseZ, (int)chunk.depth - 1);
+            int ly0 = std::max(y0, 0), ly1 = std::min(y1, (int)chunk.height - 1);
+            if (lx0 > lx1 || lz0 > lz1 || ly0 > ly1) continue;
+
+            for (int s = ly0 / SECTION_HEIGHT; s <= ly1 / SECTION_HEIGHT; s++) {
+                if (chunk.sectionEmpty(s)) continue;
+                if (chunk.sectionFull(s)) return true;
+                int sy0 = std::max(ly0, s * SECTION_HEIGHT);
+                int sy1 = std::min(ly1, s * SECTION_HEIGHT + SECTION_HEIGHT - 1);
+                for (int y = sy0; y <= sy1; y++)
+                    for (int z = lz0; z <= lz1; z++)
+                        for (int x = lx0; x <= lx1; x++)
+                            if (chunk.getType(x, y, z) != AIR) return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool WorldView::raycast(const glm::vec3& origin, const glm::vec3& dir, float maxDistance, RayHit& hit) {
+    glm::ivec3 mapPos = glm::ivec3(glm::floor(origin));
+    glm::vec3 deltaDist = glm::abs(glm::vec3(
+        1.0f / (dir.x == 0.0f ? 1e-6f : dir.x),
+        1.0f / (dir.y == 0.0f ? 1e-6f : dir.y),
+        1.0f / (dir.z == 0.0f ? 1e-6f : dir.z)));
+
+    glm::ivec3 step(
+        dir.x < 0 ? -1 : 1,
+        dir.y < 0 ? -1 : 1,
+        dir.z < 0 ? -1 : 1
+    );
+
+    glm::vec3 sideDist;
+    sideDist.x = (dir.x < 0 ? (origin.x - (float)mapPos.x) : ((float)mapPos.x + 1.0f - origin.x)) * deltaDist.x;
+    sideDist.y = (dir.y < 0 ? (origin.y - (float)mapPos.y) : ((float)mapPos.y + 1.0f - origin.y)) * deltaDist.y;
+    sideDist.z = (dir.z < 0 ? (origin.z - (float)mapPos.z) : ((float)mapPos.z + 1.0f - origin.z)) * deltaDist.z;
+
+    glm::ivec3 normal(0);
+    float dist = 0.0f;
+    while (dist <= maxDistance) {
+        if (getType(mapPos.x, mapPos.y, mapPos.z) != AIR) {
+            hit.block = mapPos;
+            hit.normal = normal;
+            hit.distance = dist;
+            return true;
+        }
+
+        if (sideDist.x < sideDist.y && sideDist.x < sideDist.z) {
+            mapPos.x += step.x;
+            dist = sideDist.x;
+            sideDist.x += deltaDist.x;
+            normal = glm::ivec3(-step.x, 0, 0);
+        } else if (sideDist.y <= sideDist.x && sideDist.y < sideDist.z) {
+            mapPos.y += step.y;
+            dist = sideDist.y;
+            sideDist.y += deltaDist.y;
+            normal = glm::ivec3(0, -step.y, 0);
+        } else {
+            mapPos.z += step.z;
+            dist = sideDist.z;
+            sideDist.z += deltaDist.z;
+            normal = glm::ivec3(0, 0, -step.z);
+        }
+    }
+    return false;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "world.h"
+#include <climits>
+#include <glm/glm.hpp>
+
+// Block queries in world coordinates for physics and picking. Remembers the
+// chunk it resolved last, so runs of queries in one chunk (every cell of an
+// AABB, every step of a ray) skip the chunk map; chunk coordinates come from
+// shifts rather than float division. Blocks outside loaded chunks or the
+// height range read as AIR.
+//
+// Main thread only, which is the only thread writing blocks. Cheap to make
+// per batch of queries; don't keep one across frames, chunks get unloaded.
+class WorldView {
+public:
+    explicit WorldView(ChunkManager& manager) : manager(manager) {}
+
+    BlockType getType(int x, int y, int z);
+    bool isSolid(int x, int y, int z) { return getType(x, y, z) != AIR; }
+
+    // Whether any block from floor(min) to floor(max) on every axis is solid,
+    // so a box ending exactly on a block's face touches it. Walks the box
+    // chunk by chunk and settles empty and full sections without reading
+    // blocks.
+    bool anySolid(const glm::vec3& min, const glm::vec3& max);
+
+    struct RayHit {
+        glm::ivec3 block;
+        glm::ivec3 normal; // face the ray entered through, 0 if it started inside
+        float distance;    // where the ray entered the block
+    };
+    // Steps through cells (DDA) from origin along dir until it enters a solid
+    // one, looking at cells entered within maxDistance
+    bool raycast(const glm::vec3& origin, const glm::vec3& dir, float maxDistance, RayHit& hit);
+
+private:
+    ManagedChunk* chunkAt(int cx, int cz);
+
+    ChunkManager& manager;
+    int cachedX = INT_MIN;
+    int cachedZ = INT_MIN;
+    ManagedChunk* cached = nullptr;
+};